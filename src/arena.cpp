@@ -0,0 +1,98 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<unsigned long long> s_HeapAllocations{ 0 };
+}
+
+// counting replacements of the global allocation functions. The array, sized and nothrow forms forward to the
+// plain pair, their over-aligned versions to the align_val_t pair
+void* operator new(size_t size)
+{
+	s_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size != 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	s_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	const size_t align{ static_cast<size_t>(alignment) };
+#ifdef _MSC_VER
+	void* p = _aligned_malloc(size != 0 ? size : 1, align);
+#else
+	void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) & ~(align - 1));
+#endif
+	if (p)
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+namespace TG
+{
+	unsigned long long HeapAllocationCount()
+	{
+		return s_HeapAllocations.load(std::memory_order_relaxed);
+	}
+
+	FrameArena::FrameArena(size_t capacity)
+		: m_Block{ capacity != 0 ? std::make_unique<std::byte[]>(capacity) : nullptr }, m_Capacity{ capacity }
+	{
+	}
+
+	// the address is what gets aligned, not the offset: the block itself is only aligned for fundamental types
+	static std::byte* AlignUp(std::byte* p, size_t alignment)
+	{
+		const uintptr_t address{ reinterpret_cast<uintptr_t>(p) };
+		return p + (((address + alignment - 1) & ~(alignment - 1)) - address);
+	}
+
+	void* FrameArena::AllocateBytes(size_t size, size_t alignment)
+	{
+		const size_t start = m_Block ? static_cast<size_t>(AlignUp(m_Block.get() + m_Offset, alignment) - m_Block.get()) : 0;
+		m_Used += size + (start - m_Offset);
+		if (m_Block && start + size <= m_Capacity)
+		{
+			m_Offset = start + size;
+			return m_Block.get() + start;
+		}
+
+		// doesn't fit: give it its own chunk for now, Reset() makes the block big enough for next frame.
+		// Padded, so the chunk has room for an aligned start
+		m_Overflow.push_back(std::make_unique<std::byte[]>(size + alignment - 1));
+		return AlignUp(m_Overflow.back().get(), alignment);
+	}
+
+	void FrameArena::Reset()
+	{
+		if (!m_Overflow.empty())
+		{
+			m_Capacity = m_Used + m_Used / 2;
+			m_Block = std::make_unique<std::byte[]>(m_Capacity);
+			m_Overflow.clear();
+		}
+		m_Offset = 0;
+		m_Used = 0;
+	}
+}
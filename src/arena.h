@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace TG
+{
+	// Linear allocator for data that lives exactly one frame. Allocate() bumps a pointer, Reset() drops everything.
+	// If a frame needs more than the block holds, the extra comes from separate chunks and the block is
+	// regrown to the peak on the next Reset(), so after the first few frames nothing touches the heap.
+	class FrameArena
+	{
+	public:
+		explicit FrameArena(size_t capacity = 64 * 1024);
+		FrameArena(const FrameArena& other) = delete;
+		FrameArena(FrameArena&& other) = default;
+
+		// memory is uninitialized and never destructed, so only trivial types are allowed
+		template <typename T>
+		T* Allocate(size_t count)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "FrameArena never runs destructors");
+			return static_cast<T*>(AllocateBytes(sizeof(T) * count, alignof(T)));
+		}
+
+		void Reset();
+
+		size_t Used() const { return m_Used; }
+		size_t Capacity() const { return m_Capacity; }
+
+	private:
+		std::unique_ptr<std::byte[]> m_Block{};
+		size_t m_Capacity{};
+		size_t m_Offset{};
+		size_t m_Used{}; // this frame, overflow included
+		std::vector<std::unique_ptr<std::byte[]>> m_Overflow{};
+
+	private:
+		void* AllocateBytes(size_t size, size_t alignment);
+	};
+
+	// number of global operator new calls since startup, to check that steady-state frames don't allocate
+	unsigned long long HeapAllocationCount();
+}
@@ -0,0 +1,209 @@
+#include "commandbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <string>
+
+namespace TG
+{
+	namespace
+	{
+		constexpr char FileMagic[4]{ 'T', 'G', 'C', 'B' };
+		constexpr uint32_t FileVersion{ 3 };
+
+		// raw dumps in the machine's byte order, recordings are meant to be replayed on the same kind of machine
+		template <typename T>
+		void WriteValues(std::ofstream& file, const T* values, size_t count)
+		{
+			file.write(reinterpret_cast<const char*>(values), static_cast<std::streamsize>(sizeof(T) * count));
+		}
+
+		template <typename T>
+		void ReadValues(std::ifstream& file, T* values, size_t count)
+		{
+			if (!file.read(reinterpret_cast<char*>(values), static_cast<std::streamsize>(sizeof(T) * count)))
+				throw std::exception("Command buffer file is truncated");
+		}
+
+		uint32_t ReadCount(std::ifstream& file)
+		{
+			uint32_t count{};
+			ReadValues(file, &count, 1);
+			return count;
+		}
+	}
+
+	const Matrix4& CommandBuffer::Identity()
+	{
+		static const Matrix4 identity{
+			{
+				{1, 0, 0, 0},
+				{0, 1, 0, 0},
+				{0, 0, 1, 0},
+				{0, 0, 0, 1}
+			}
+		};
+		return identity;
+	}
+
+	void CommandBuffer::Reset()
+	{
+		m_Commands.clear();
+		m_Transforms.clear();
+		m_Meshes.clear();
+		m_Points.clear();
+		m_OwnedMeshes.clear();
+	}
+
+	void CommandBuffer::SetTransform(const Matrix4& world)
+	{
+		m_Commands.push_back(Command{ CommandType::SetTransform, static_cast<uint32_t>(m_Transforms.size()) });
+		m_Transforms.push_back(world);
+	}
+
+	uint32_t CommandBuffer::MeshIndex(const Mesh& mesh)
+	{
+		auto found = std::find(m_Meshes.begin(), m_Meshes.end(), &mesh);
+		if (found == m_Meshes.end())
+			found = m_Meshes.insert(m_Meshes.end(), &mesh);
+		return static_cast<uint32_t>(found - m_Meshes.begin());
+	}
+
+	void CommandBuffer::DrawMesh(const Mesh& mesh)
+	{
+		m_Commands.push_back(Command{ CommandType::DrawMesh, MeshIndex(mesh) });
+	}
+
+	void CommandBuffer::DrawInstanced(const Mesh& mesh, const Matrix4* transforms, size_t count)
+	{
+		m_Commands.push_back(Command{
+			CommandType::DrawInstanced, MeshIndex(mesh), static_cast<uint32_t>(count), NoGlyph,
+			static_cast<uint32_t>(m_Transforms.size())
+		});
+		m_Transforms.insert(m_Transforms.end(), transforms, transforms + count);
+	}
+
+	void CommandBuffer::DrawLines(const Vector3* points, size_t count, Glyph filler)
+	{
+		m_Commands.push_back(Command{
+			CommandType::DrawLines, static_cast<uint32_t>(m_Points.size()), static_cast<uint32_t>(count & ~size_t{ 1 }), filler
+		});
+		m_Points.insert(m_Points.end(), points, points + (count & ~size_t{ 1 }));
+	}
+
+	bool CommandBuffer::Save(const char* fileName) const
+	{
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+			return false;
+
+		file.write(FileMagic, sizeof(FileMagic));
+		WriteValues(file, &FileVersion, 1);
+
+		const uint32_t meshCount = static_cast<uint32_t>(m_Meshes.size());
+		WriteValues(file, &meshCount, 1);
+		for (const Mesh* mesh : m_Meshes)
+		{
+			const uint32_t triCount = static_cast<uint32_t>(mesh->Tris.size());
+			WriteValues(file, &triCount, 1);
+			for (const Triangle& tri : mesh->Tris)
+			{
+				WriteValues(file, tri.verts, 3);
+			}
+			const uint32_t quadCount = static_cast<uint32_t>(mesh->Quads.size());
+			WriteValues(file, &quadCount, 1);
+			for (const Quad& quad : mesh->Quads)
+			{
+				WriteValues(file, quad.verts, 4);
+			}
+		}
+
+		const uint32_t transformCount = static_cast<uint32_t>(m_Transforms.size());
+		WriteValues(file, &transformCount, 1);
+		WriteValues(file, m_Transforms.data(), m_Transforms.size());
+
+		const uint32_t pointCount = static_cast<uint32_t>(m_Points.size());
+		WriteValues(file, &pointCount, 1);
+		WriteValues(file, m_Points.data(), m_Points.size());
+
+		const uint32_t commandCount = static_cast<uint32_t>(m_Commands.size());
+		WriteValues(file, &commandCount, 1);
+		for (const Command& command : m_Commands)
+		{
+			const uint32_t fields[4]{ static_cast<uint32_t>(command.Type), command.Index, command.Count, command.First };
+			WriteValues(file, fields, 4);
+			// glyph indices depend on what was interned first, store the glyph itself
+			const char* filler = command.Filler != NoGlyph ? GlyphUtf8(command.Filler) : "";
+			const uint32_t fillerSize = static_cast<uint32_t>(strlen(filler));
+			WriteValues(file, &fillerSize, 1);
+			WriteValues(file, filler, fillerSize);
+		}
+		return static_cast<bool>(file);
+	}
+
+	CommandBuffer CommandBuffer::Load(const char* fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file)
+			throw std::exception("File is not open");
+
+		char magic[4]{};
+		ReadValues(file, magic, 4);
+		if (memcmp(magic, FileMagic, sizeof(FileMagic)) != 0 || ReadCount(file) != FileVersion)
+			throw std::exception("Not a command buffer file");
+
+		CommandBuffer buffer{};
+		for (uint32_t meshCount = ReadCount(file); meshCount > 0; meshCount--)
+		{
+			auto mesh = std::make_unique<Mesh>();
+			mesh->Tris.resize(ReadCount(file));
+			for (Triangle& tri : mesh->Tris)
+			{
+				ReadValues(file, tri.verts, 3);
+			}
+			mesh->Quads.resize(ReadCount(file));
+			for (Quad& quad : mesh->Quads)
+			{
+				ReadValues(file, quad.verts, 4);
+			}
+			mesh->Touch();
+			buffer.m_Meshes.push_back(mesh.get());
+			buffer.m_OwnedMeshes.push_back(std::move(mesh));
+		}
+
+		buffer.m_Transforms.resize(ReadCount(file));
+		ReadValues(file, buffer.m_Transforms.data(), buffer.m_Transforms.size());
+		buffer.m_Points.resize(ReadCount(file));
+		ReadValues(file, buffer.m_Points.data(), buffer.m_Points.size());
+
+		buffer.m_Commands.resize(ReadCount(file));
+		std::string filler{};
+		for (Command& command : buffer.m_Commands)
+		{
+			uint32_t fields[4]{};
+			ReadValues(file, fields, 4);
+			command.Type = static_cast<CommandType>(fields[0]);
+			command.Index = fields[1];
+			command.Count = fields[2];
+			command.First = fields[3];
+
+			filler.resize(ReadCount(file));
+			ReadValues(file, filler.data(), filler.size());
+			command.Filler = filler.empty() ? NoGlyph : InternGlyph(filler.c_str());
+
+			// indices have to stay inside the tables, the renderer doesn't check them again
+			const bool valid =
+				(command.Type == CommandType::SetTransform && command.Index < buffer.m_Transforms.size()) ||
+				(command.Type == CommandType::DrawMesh && command.Index < buffer.m_Meshes.size()) ||
+				(command.Type == CommandType::DrawLines &&
+				 static_cast<size_t>(command.Index) + command.Count <= buffer.m_Points.size()) ||
+				(command.Type == CommandType::DrawInstanced && command.Index < buffer.m_Meshes.size() &&
+				 static_cast<size_t>(command.First) + command.Count <= buffer.m_Transforms.size());
+			if (!valid)
+				throw std::exception("Command buffer file is corrupted");
+		}
+		return buffer;
+	}
+}
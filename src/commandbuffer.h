@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "tgraphics.h"
+
+namespace TG
+{
+	enum class CommandType : uint32_t
+	{
+		SetTransform,
+		DrawMesh,
+		DrawLines,
+		DrawInstanced
+	};
+
+	struct Command
+	{
+		CommandType Type{};
+		uint32_t Index{}; // into the buffer's transforms, meshes or line points
+		uint32_t Count{}; // line points or instances
+		Glyph Filler{ NoGlyph }; // lines only
+		uint32_t First{}; // instances only: their first transform
+	};
+
+	// Draw calls recorded for later. A buffer is recorded by one thread; record several in parallel and hand
+	// them to Graphics::Submit together. Submit renders all of them as one frame: every mesh is transformed in
+	// parallel and depth sorted together with the others, so the order of DrawMesh calls doesn't matter.
+	// Lines go on top, in recording order.
+	// Meshes are referenced, not copied: keep them alive and unchanged until the buffer has been submitted
+	class CommandBuffer
+	{
+	public:
+		void Reset();
+
+		// world transform of the following draws, applied before the camera. Every buffer starts with identity
+		void SetTransform(const Matrix4& world);
+		void DrawMesh(const Mesh& mesh);
+		// the mesh once per transform, in place of the current one. Instances share everything computed from
+		// the mesh itself, only their transforms are stored per instance
+		void DrawInstanced(const Mesh& mesh, const Matrix4* transforms, size_t count);
+		// a segment between every pair of points, in world space like mesh vertices. NoGlyph lines are kept but not drawn
+		void DrawLines(const Vector3* points, size_t count, Glyph filler);
+
+		const std::vector<Command>& Commands() const { return m_Commands; }
+		const Matrix4& Transform(uint32_t index) const { return m_Transforms[index]; }
+		const Mesh& MeshAt(uint32_t index) const { return *m_Meshes[index]; }
+		const Vector3* Points(uint32_t index) const { return m_Points.data() + index; }
+
+		// binary dump with the meshes' geometry, so a recorded frame can be replayed on its own
+		bool Save(const char* fileName) const;
+		static CommandBuffer Load(const char* fileName);
+
+		static const Matrix4& Identity();
+
+	private:
+		uint32_t MeshIndex(const Mesh& mesh);
+
+	private:
+		std::vector<Command> m_Commands{};
+		std::vector<Matrix4> m_Transforms{};
+		std::vector<const Mesh*> m_Meshes{}; // each mesh once, however often it's drawn
+		std::vector<Vector3> m_Points{};
+		std::vector<std::unique_ptr<Mesh>> m_OwnedMeshes{}; // the meshes of a loaded buffer
+	};
+}
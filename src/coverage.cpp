@@ -0,0 +1,18 @@
+#include "coverage.h"
+
+#include <numeric>
+
+namespace TG
+{
+	void CoverageBuffer::Reset(int width, int height)
+	{
+		m_Width = width;
+		m_Next.resize(static_cast<size_t>(width + 1) * height);
+		for (int row = 0; row < height; row++)
+		{
+			uint16_t* next = m_Next.data() + static_cast<size_t>(row) * (width + 1);
+			std::iota(next, next + width + 1, uint16_t{ 0 });
+		}
+		m_Open.assign(height, width);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TG
+{
+	// Which cells of a front-to-back frame are final already. Per row, every cell points at the nearest column at or
+	// right of it that's still open (a union-find with path halving), so a span skips covered runs in one step
+	// and only ever touches the cells it writes. Rows are independent: bands of rows can be filled in parallel
+	class CoverageBuffer
+	{
+	public:
+		// everything open again, for a width x height frame
+		void Reset(int width, int height);
+
+		bool RowFull(int row) const { return m_Open[row] == 0; }
+
+		// calls write(column) for the open cells of [first, last] on row and closes them. Returns how many
+		template <typename Write>
+		size_t Fill(int row, int first, int last, Write&& write)
+		{
+			uint16_t* next = m_Next.data() + static_cast<size_t>(row) * (m_Width + 1);
+			size_t written{ 0 };
+			for (int column = Find(next, first); column <= last; column = Find(next, column + 1))
+			{
+				write(column);
+				next[column] = static_cast<uint16_t>(column + 1);
+				written++;
+			}
+			m_Open[row] -= static_cast<int>(written);
+			return written;
+		}
+
+	private:
+		static int Find(uint16_t* next, int column)
+		{
+			while (next[column] != column)
+			{
+				next[column] = next[next[column]];
+				column = next[column];
+			}
+			return column;
+		}
+
+	private:
+		int m_Width{};
+		std::vector<uint16_t> m_Next{}; // width + 1 per row, the last one is never closed
+		std::vector<int> m_Open{}; // cells per row
+	};
+}
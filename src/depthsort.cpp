@@ -0,0 +1,171 @@
+#include "depthsort.h"
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace TG
+{
+	constexpr unsigned MaxSortThreads{ 16 };
+	constexpr size_t ParallelSortThreshold{ 1 << 16 }; // below this waking workers costs more than it saves
+	constexpr int RadixBits{ 8 };
+	constexpr size_t RadixBuckets{ 1 << RadixBits };
+
+	// runs body(chunk, begin, end) for every chunk of [0, count)
+	template <typename Body>
+	static void ForEachChunk(JobSystem* jobs, unsigned chunks, size_t count, Body&& body)
+	{
+		auto run = [&](size_t chunk)
+		{
+			body(static_cast<unsigned>(chunk), count * chunk / chunks, count * (chunk + 1) / chunks);
+		};
+
+		if (jobs)
+			jobs->ParallelFor(chunks, run);
+		else
+			run(0);
+	}
+
+	void RadixSort(DepthKey* keys, DepthKey* scratch, size_t count, JobSystem* jobs)
+	{
+		if (count < 2)
+			return;
+
+		if (count < ParallelSortThreshold)
+			jobs = nullptr;
+		const unsigned chunks = jobs ? std::min(jobs->Size(), MaxSortThreads) : 1;
+		size_t histograms[MaxSortThreads][RadixBuckets];
+
+		DepthKey* src{ keys };
+		DepthKey* dst{ scratch };
+		for (int shift = 0; shift < 32; shift += RadixBits)
+		{
+			ForEachChunk(jobs, chunks, count, [&](unsigned chunk, size_t begin, size_t end)
+			{
+				size_t* histogram = histograms[chunk];
+				std::fill(histogram, histogram + RadixBuckets, 0);
+				for (size_t i = begin; i < end; i++)
+				{
+					histogram[(src[i].Key >> shift) & (RadixBuckets - 1)]++;
+				}
+			});
+
+			// turn counts into write offsets: bucket-major, then chunk order, so equal digits stay in input order
+			size_t offset{ 0 };
+			bool trivial{ false };
+			for (size_t bucket = 0; bucket < RadixBuckets; bucket++)
+			{
+				const size_t bucketStart = offset;
+				for (unsigned chunk = 0; chunk < chunks; chunk++)
+				{
+					const size_t n = histograms[chunk][bucket];
+					histograms[chunk][bucket] = offset;
+					offset += n;
+				}
+				if (offset - bucketStart == count) // every key has this digit, the pass wouldn't change anything
+				{
+					trivial = true;
+					break;
+				}
+			}
+			if (trivial)
+				continue;
+
+			ForEachChunk(jobs, chunks, count, [&](unsigned chunk, size_t begin, size_t end)
+			{
+				size_t* offsets = histograms[chunk];
+				for (size_t i = begin; i < end; i++)
+				{
+					dst[offsets[(src[i].Key >> shift) & (RadixBuckets - 1)]++] = src[i];
+				}
+			});
+			std::swap(src, dst);
+		}
+
+		if (src != keys)
+			std::memcpy(keys, src, count * sizeof(DepthKey));
+	}
+
+	// insertion sort, stops early once maxMoves is used up. Returns false if it didn't finish
+	static bool RepairSort(DepthKey* keys, size_t count, size_t maxMoves, size_t& moves)
+	{
+		for (size_t i = 1; i < count; i++)
+		{
+			const DepthKey key = keys[i];
+			size_t j = i;
+			while (j > 0 && keys[j - 1].Key > key.Key)
+			{
+				keys[j] = keys[j - 1];
+				j--;
+				if (++moves > maxMoves)
+				{
+					keys[j] = key;
+					return false;
+				}
+			}
+			keys[j] = key;
+		}
+		return true;
+	}
+
+	void CoherentDepthSort::Sort(DepthKey* keys, DepthKey* scratch, const uint32_t* ids, size_t count, size_t idCount,
+	                             JobSystem* jobs)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		// ids that went away simply aren't found again, so the table only ever grows
+		if (m_SlotOf.size() < idCount)
+			m_SlotOf.resize(idCount, -1);
+		for (size_t i = 0; i < count; i++)
+		{
+			m_SlotOf[ids[i]] = static_cast<int32_t>(i);
+		}
+
+		// keys that were visible last frame go first, in last frame's order, then whatever became visible since.
+		// Every visited slot is reset to -1, so m_SlotOf is clean again for the next frame
+		size_t n{ 0 };
+		for (uint32_t id : m_PrevOrder)
+		{
+			if (int32_t slot = m_SlotOf[id]; slot >= 0)
+			{
+				scratch[n++] = keys[slot];
+				m_SlotOf[id] = -1;
+			}
+		}
+		const size_t reused{ n };
+		for (size_t i = 0; i < count; i++)
+		{
+			if (m_SlotOf[ids[i]] >= 0)
+			{
+				scratch[n++] = keys[i];
+				m_SlotOf[ids[i]] = -1;
+			}
+		}
+		std::memcpy(keys, scratch, count * sizeof(DepthKey));
+
+		m_Stats = SortStats{ count, reused };
+		// mostly new keys have no useful order to repair
+		if (reused * 2 < count || !RepairSort(keys, reused, reused * MaxMovesPerKey, m_Stats.Moves))
+		{
+			RadixSort(keys, scratch, count, jobs);
+			m_Stats.FullSort = true;
+		}
+		else if (reused < count)
+		{
+			// newcomers are few: sort them on their own, then merge the two sorted runs
+			RadixSort(keys + reused, scratch, count - reused, jobs);
+			std::merge(keys, keys + reused, keys + reused, keys + count, scratch,
+			           [](const DepthKey& a, const DepthKey& b) { return a.Key < b.Key; });
+			std::memcpy(keys, scratch, count * sizeof(DepthKey));
+		}
+
+		m_PrevOrder.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			m_PrevOrder[i] = ids[keys[i].Index];
+		}
+
+		m_Stats.Time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	}
+}
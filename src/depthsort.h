@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace TG
+{
+	class JobSystem;
+
+	// painter's order sort entry: triangles themselves never move, only these 8 byte keys do
+	struct DepthKey
+	{
+		uint32_t Key{};
+		uint32_t Index{};
+	};
+
+	// Maps a depth to a key that sorts far-to-near in ascending order.
+	// IEEE floats compare like sign-magnitude ints, so flipping the bits turns them into plain unsigned order
+	inline uint32_t DepthSortKey(float depth)
+	{
+		uint32_t bits{};
+		std::memcpy(&bits, &depth, sizeof(bits));
+		bits ^= (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u; // ascending by depth
+		return ~bits; // far first
+	}
+
+	// Stable LSD radix sort by Key, 8 bits per pass; passes where every key has the same digit are skipped.
+	// scratch must hold count entries. With a job system, big inputs are split into chunks with their own
+	// histograms, which keeps the result identical to the single threaded one
+	void RadixSort(DepthKey* keys, DepthKey* scratch, size_t count, JobSystem* jobs = nullptr);
+
+	struct SortStats
+	{
+		size_t Keys{};
+		size_t Reused{}; // keys that kept their place from last frame's order
+		size_t Moves{}; // shifts the repair pass needed
+		bool FullSort{}; // order was too far off and got radix sorted from scratch
+		float Time{}; // seconds
+	};
+
+	// Depth sort that starts from last frame's order. Small rotations only swap a few neighbours,
+	// so an insertion sort over the old permutation is close to linear; newly visible keys are sorted
+	// separately and merged in. When the repair has to move more than MaxMovesPerKey per key on average
+	// it gives up and falls back to RadixSort
+	class CoherentDepthSort
+	{
+	public:
+		size_t MaxMovesPerKey{ 4 };
+
+		// keys[i].Index is a position in the caller's list, ids[i] is that entry's stable id (< idCount),
+		// used to find it again next frame. idCount may change between frames. scratch must hold count entries
+		void Sort(DepthKey* keys, DepthKey* scratch, const uint32_t* ids, size_t count, size_t idCount, JobSystem* jobs = nullptr);
+		// forget the previous order, e.g. when ids stop meaning the same thing
+		void Invalidate() { m_PrevOrder.clear(); }
+
+		const SortStats& Stats() const { return m_Stats; }
+
+	private:
+		std::vector<uint32_t> m_PrevOrder{}; // ids in last frame's sorted order
+		std::vector<int32_t> m_SlotOf{}; // id -> position in keys while sorting, -1 otherwise
+		SortStats m_Stats{};
+	};
+}
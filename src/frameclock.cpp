@@ -0,0 +1,112 @@
+#include "frameclock.h"
+
+#include <algorithm>
+
+namespace TG
+{
+	FrameScheduler::FrameScheduler(float targetFps, float simulationStep)
+		: m_Step{ simulationStep }
+	{
+		// high resolution timers exist since Windows 10 1803, older systems get NULL and fall back to Sleep()
+		m_Timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+		SetTargetRate(targetFps);
+		m_FrameStart = clock::now();
+		m_NextFrame = m_FrameStart + m_FramePeriod;
+		m_FrameStartCpu = ProcessCpuTime();
+	}
+
+	FrameScheduler::~FrameScheduler()
+	{
+		if (m_Timer)
+			CloseHandle(m_Timer);
+	}
+
+	void FrameScheduler::SetTargetRate(float fps)
+	{
+		if (fps <= 0.0f)
+		{
+			m_FramePeriod = clock::duration::zero();
+			return;
+		}
+		m_FramePeriod = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(1.0f / fps));
+	}
+
+	int FrameScheduler::BeginFrame()
+	{
+		const clock::time_point now = clock::now();
+		const unsigned long long cpu = ProcessCpuTime();
+
+		m_Timing.FrameTime = std::chrono::duration<float>(now - m_FrameStart).count();
+		m_Timing.CpuUtilization = m_Timing.FrameTime > 0.0f
+			                          ? static_cast<float>(cpu - m_FrameStartCpu) * 1e-7f / m_Timing.FrameTime
+			                          : 0.0f;
+		m_FrameStart = now;
+		m_FrameStartCpu = cpu;
+
+		m_Accumulator = std::min(m_Accumulator + m_Timing.FrameTime, MaxAccumulated);
+		int steps{ 0 };
+		while (m_Accumulator >= m_Step)
+		{
+			m_Accumulator -= m_Step;
+			steps++;
+		}
+		m_Timing.Alpha = m_Accumulator / m_Step;
+
+		return steps;
+	}
+
+	void FrameScheduler::EndFrame()
+	{
+		const clock::time_point now = clock::now();
+		m_Timing.BusyTime = std::chrono::duration<float>(now - m_FrameStart).count();
+
+		if (m_FramePeriod == clock::duration::zero())
+			return;
+
+		m_NextFrame += m_FramePeriod;
+		if (m_NextFrame <= now) // running behind: start the next frame right away instead of bursting to catch up
+		{
+			m_NextFrame = now;
+			return;
+		}
+		SleepUntil(m_NextFrame);
+	}
+
+	void FrameScheduler::SleepUntil(clock::time_point deadline)
+	{
+		const clock::duration remaining = deadline - clock::now();
+		if (remaining > SpinThreshold)
+		{
+			const clock::duration wait = remaining - SpinThreshold;
+			LARGE_INTEGER due{};
+			due.QuadPart = -static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count() / 100); // relative, 100ns units
+			if (m_Timer && SetWaitableTimer(m_Timer, &due, 0, nullptr, nullptr, FALSE))
+			{
+				WaitForSingleObject(m_Timer, INFINITE);
+			}
+			else
+			{
+				Sleep(static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(wait).count()));
+			}
+		}
+
+		while (clock::now() < deadline)
+		{
+			YieldProcessor();
+		}
+	}
+
+	unsigned long long FrameScheduler::ProcessCpuTime()
+	{
+		FILETIME creation{}, exit{}, kernel{}, user{};
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+			return 0;
+
+		auto toU64 = [](const FILETIME& ft)
+		{
+			return (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+		};
+		return toU64(kernel) + toU64(user);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Windows.h>
+#include <chrono>
+
+namespace TG
+{
+	struct FrameTiming
+	{
+		float FrameTime{}; // wall time of the last frame, pacing sleep included
+		float BusyTime{}; // part of FrameTime spent working
+		float CpuUtilization{}; // process CPU time / FrameTime (1.0 = one core fully busy)
+		float Alpha{}; // how far render time is between the last two simulation steps, [0, 1)
+	};
+
+	// Paces the main loop to a target frame rate and hands out fixed simulation steps.
+	// Sleeping is hybrid: an OS wait for the bulk of the slack, then a short spin for the last bit,
+	// because OS waits alone overshoot by up to a scheduler tick.
+	class FrameScheduler
+	{
+	public:
+		typedef std::chrono::steady_clock clock;
+
+		explicit FrameScheduler(float targetFps = 60.0f, float simulationStep = 1.0f / 120.0f);
+		FrameScheduler(const FrameScheduler& other) = delete;
+		~FrameScheduler();
+
+		// 0 disables pacing
+		void SetTargetRate(float fps);
+
+		// returns how many Step()-sized simulation updates to run before rendering this frame
+		int BeginFrame();
+		// call after the frame is presented: records timings and sleeps until the next frame is due
+		void EndFrame();
+
+		float Step() const { return m_Step; }
+		const FrameTiming& Timing() const { return m_Timing; }
+
+	private:
+		float m_Step{};
+		clock::duration m_FramePeriod{};
+		clock::time_point m_FrameStart{};
+		clock::time_point m_NextFrame{};
+		float m_Accumulator{};
+		unsigned long long m_FrameStartCpu{};
+		HANDLE m_Timer{};
+		FrameTiming m_Timing{};
+
+		constexpr static std::chrono::microseconds SpinThreshold{ 1500 };
+		constexpr static float MaxAccumulated{ 0.25f }; // don't try to catch up after a long stall
+
+	private:
+		void SleepUntil(clock::time_point deadline);
+		static unsigned long long ProcessCpuTime(); // in 100ns units
+	};
+}
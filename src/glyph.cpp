@@ -0,0 +1,123 @@
+#include "glyph.h"
+
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+
+namespace TG
+{
+	namespace
+	{
+		constexpr size_t GlyphCount{ 256 };
+		constexpr size_t EncodingCount{ 3 };
+
+		struct GlyphTables
+		{
+			EncodedGlyph Encoded[EncodingCount][GlyphCount]{};
+			std::string Utf8[GlyphCount]{};
+			size_t Count{ 128 }; // ASCII is always there
+			std::mutex Mutex{};
+		};
+
+		uint32_t DecodeUtf8(const char* utf8)
+		{
+			const auto* bytes = reinterpret_cast<const unsigned char*>(utf8);
+			const int length = bytes[0] < 0x80 ? 1 : bytes[0] < 0xE0 ? 2 : bytes[0] < 0xF0 ? 3 : 4;
+			uint32_t codePoint = length == 1 ? bytes[0] : bytes[0] & (0x7F >> length);
+			for (int i = 1; i < length && bytes[i] != 0; i++)
+				codePoint = (codePoint << 6) | (bytes[i] & 0x3F);
+			return codePoint;
+		}
+
+		// the blocks and box lines a shade or a line is likely to use, 0 if CP437 has no such character
+		unsigned char Cp437Of(uint32_t codePoint)
+		{
+			static constexpr struct
+			{
+				uint32_t CodePoint;
+				unsigned char Code;
+			} codes[]{
+				{ 0x2588, 0xDB }, { 0x2593, 0xB2 }, { 0x2592, 0xB1 }, { 0x2591, 0xB0 }, { 0x2580, 0xDF }, { 0x2584, 0xDC },
+				{ 0x258C, 0xDD }, { 0x2590, 0xDE }, { 0x25A0, 0xFE }, { 0x2500, 0xC4 }, { 0x2502, 0xB3 }, { 0x253C, 0xC5 },
+				{ 0x00B7, 0xFA }, { 0x2219, 0xF9 }, { 0x00B0, 0xF8 },
+			};
+			for (const auto& code : codes)
+			{
+				if (code.CodePoint == codePoint)
+					return code.Code;
+			}
+			return 0;
+		}
+
+		EncodedGlyph Encode(const char* bytes, size_t size)
+		{
+			EncodedGlyph encoded{};
+			std::memcpy(encoded.Bytes, bytes, size);
+			encoded.Size = static_cast<uint8_t>(size);
+			return encoded;
+		}
+
+		void Add(GlyphTables& tables, size_t glyph, const char* utf8, char ascii)
+		{
+			const char cp437 = static_cast<char>(Cp437Of(DecodeUtf8(utf8)));
+			tables.Utf8[glyph] = utf8;
+			tables.Encoded[static_cast<size_t>(GlyphEncoding::Utf8)][glyph] = Encode(utf8, std::strlen(utf8));
+			tables.Encoded[static_cast<size_t>(GlyphEncoding::Cp437)][glyph] = Encode(cp437 ? &cp437 : &ascii, 1);
+			tables.Encoded[static_cast<size_t>(GlyphEncoding::Ascii)][glyph] = Encode(&ascii, 1);
+		}
+
+		// lives as long as the program, encoders may be reading it until the very end
+		GlyphTables& Tables()
+		{
+			static GlyphTables* tables = []
+			{
+				auto* created = new GlyphTables();
+				for (size_t c = 0; c < 128; c++)
+				{
+					const char ascii = static_cast<char>(AsciiGlyph(static_cast<char>(c)));
+					const char utf8[2]{ ascii, '\0' };
+					Add(*created, c, utf8, ascii);
+				}
+				Add(*created, GlyphFull, "█", '@');
+				Add(*created, GlyphDark, "▓", '#');
+				Add(*created, GlyphMedium, "▒", '+');
+				Add(*created, GlyphLight, "░", '.');
+				created->Count = GlyphLight + 1;
+				return created;
+			}();
+			return *tables;
+		}
+	}
+
+	Glyph InternGlyph(const char* utf8, char ascii)
+	{
+		if (utf8[0] != '\0' && utf8[1] == '\0')
+			return AsciiGlyph(utf8[0]);
+
+		GlyphTables& tables = Tables();
+		std::lock_guard lock(tables.Mutex);
+		for (size_t glyph = 128; glyph < tables.Count; glyph++)
+		{
+			if (tables.Utf8[glyph] == utf8)
+				return static_cast<Glyph>(glyph);
+		}
+		if (std::strlen(utf8) > MaxGlyphBytes)
+			throw std::exception("Glyph is longer than one character");
+		if (tables.Count == GlyphCount)
+			throw std::exception("Glyph table is full");
+		// written before anyone gets the index, encoders never read a half written entry
+		Add(tables, tables.Count, utf8, AsciiGlyph(ascii));
+		return static_cast<Glyph>(tables.Count++);
+	}
+
+	const char* GlyphUtf8(Glyph glyph)
+	{
+		return Tables().Utf8[glyph].c_str();
+	}
+
+	const EncodedGlyph* GlyphTable(GlyphEncoding encoding)
+	{
+		return Tables().Encoded[static_cast<size_t>(encoding)];
+	}
+}
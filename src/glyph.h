@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TG
+{
+	// what a cell shows, as an index into the glyph table. ASCII is its own index, everything else is interned
+	// past it, so a cell is one byte instead of a pointer to a string
+	using Glyph = uint8_t;
+
+	constexpr Glyph NoGlyph{ 0 }; // never drawn: a face that was clipped away, a line without a filler
+	// the shade blocks, always in the table
+	constexpr Glyph GlyphFull{ 128 };
+	constexpr Glyph GlyphDark{ 129 };
+	constexpr Glyph GlyphMedium{ 130 };
+	constexpr Glyph GlyphLight{ 131 };
+
+	// ASCII is its own glyph, control chars show as '?'
+	inline Glyph AsciiGlyph(char c) { return c >= 32 && c < 127 ? static_cast<Glyph>(c) : Glyph{ '?' }; }
+
+	// what the terminal is sent. Glyphs an encoding has no code for go out as their ASCII stand-in
+	enum class GlyphEncoding
+	{
+		Utf8,
+		Cp437, // the console's OEM code page: block and box characters as one byte each
+		Ascii
+	};
+
+	constexpr size_t MaxGlyphBytes{ 4 };
+
+	// a glyph's bytes in one encoding. Bytes is padded, the encoder copies all of it and moves on by Size
+	struct EncodedGlyph
+	{
+		char Bytes[MaxGlyphBytes];
+		uint8_t Size;
+	};
+
+	// the glyph of a one-cell UTF-8 string, added to the table if it's new; ascii stands in for it where the
+	// encoding can't show it. Throws once the table is full
+	Glyph InternGlyph(const char* utf8, char ascii = '?');
+	const char* GlyphUtf8(Glyph glyph);
+	// every glyph's bytes in encoding, indexed by Glyph. Glyphs interned later show up in it too
+	const EncodedGlyph* GlyphTable(GlyphEncoding encoding);
+}
@@ -0,0 +1,92 @@
+#include "instancing.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TG_CULL_SSE2
+#endif
+
+namespace TG
+{
+	// a box is outside a plane when even its corner furthest along the normal is behind it:
+	// distance of the center + the extents projected on the normal < 0
+	static bool BoxVisible(const float center[3], const float extent[3], const Frustum& frustum)
+	{
+		for (const Plane& plane : frustum.Planes)
+		{
+			const float distance = plane.Normal.x * center[0] + plane.Normal.y * center[1] + plane.Normal.z * center[2] + plane.D;
+			const float radius = std::fabs(plane.Normal.x) * extent[0] + std::fabs(plane.Normal.y) * extent[1] +
+				std::fabs(plane.Normal.z) * extent[2];
+			if (distance + radius < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	size_t CullInstances(const Bounds& local, const Matrix4* transforms, size_t count, const Frustum& frustum,
+	                     uint32_t* visible)
+	{
+		const float center[3]{ (local.Min.x + local.Max.x) * 0.5f, (local.Min.y + local.Max.y) * 0.5f, (local.Min.z + local.Max.z) * 0.5f };
+		const float extent[3]{ (local.Max.x - local.Min.x) * 0.5f, (local.Max.y - local.Min.y) * 0.5f, (local.Max.z - local.Min.z) * 0.5f };
+
+		size_t visibleCount{ 0 };
+		size_t i{ 0 };
+#ifdef TG_CULL_SSE2
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		for (; i + 4 <= count; i += 4)
+		{
+			const Matrix4* batch = transforms + i;
+			auto lanes = [batch](int row, int col)
+			{
+				return _mm_setr_ps(batch[0].m[row][col], batch[1].m[row][col], batch[2].m[row][col], batch[3].m[row][col]);
+			};
+
+			// same as TransformBounds, for four instances at once
+			__m128 worldCenter[3];
+			__m128 worldExtent[3];
+			for (int col = 0; col < 3; col++)
+			{
+				worldCenter[col] = lanes(3, col);
+				worldExtent[col] = _mm_setzero_ps();
+				for (int row = 0; row < 3; row++)
+				{
+					const __m128 m = lanes(row, col);
+					worldCenter[col] = _mm_add_ps(worldCenter[col], _mm_mul_ps(_mm_set1_ps(center[row]), m));
+					worldExtent[col] = _mm_add_ps(worldExtent[col], _mm_mul_ps(_mm_set1_ps(extent[row]), _mm_and_ps(m, absMask)));
+				}
+			}
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const Plane& plane : frustum.Planes)
+			{
+				__m128 distance = _mm_set1_ps(plane.D);
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.Normal.x), worldCenter[0]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.Normal.y), worldCenter[1]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.Normal.z), worldCenter[2]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::fabs(plane.Normal.x)), worldExtent[0]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::fabs(plane.Normal.y)), worldExtent[1]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::fabs(plane.Normal.z)), worldExtent[2]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+			}
+
+			const int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if (mask & (1 << lane))
+					visible[visibleCount++] = static_cast<uint32_t>(i + lane);
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			const Bounds world = TransformBounds(local, transforms[i]);
+			const float worldCenter[3]{ (world.Min.x + world.Max.x) * 0.5f, (world.Min.y + world.Max.y) * 0.5f, (world.Min.z + world.Max.z) * 0.5f };
+			const float worldExtent[3]{ (world.Max.x - world.Min.x) * 0.5f, (world.Max.y - world.Min.y) * 0.5f, (world.Max.z - world.Min.z) * 0.5f };
+			if (BoxVisible(worldCenter, worldExtent, frustum))
+				visible[visibleCount++] = static_cast<uint32_t>(i);
+		}
+		return visibleCount;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "tgraphics.h"
+
+namespace TG
+{
+	// Tests the instances' bounds (local, moved by each transform) against the frustum and writes the indices
+	// of those that may be visible to visible[], in order. Returns how many.
+	// Four instances go through at a time in SSE registers, one lane each; what's left over is done one by one
+	size_t CullInstances(const Bounds& local, const Matrix4* transforms, size_t count, const Frustum& frustum,
+	                     uint32_t* visible);
+}
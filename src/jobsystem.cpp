@@ -0,0 +1,241 @@
+#include "jobsystem.h"
+
+#include <exception>
+#include <fstream>
+
+namespace TG
+{
+	namespace
+	{
+		thread_local unsigned t_Worker{ 0 }; // worker threads are 1..n, everyone else shares queue 0
+	}
+
+	bool JobSystem::WorkQueue::Push(Job* job)
+	{
+		std::lock_guard lock(Mutex);
+		if (Count == QueueCapacity)
+			return false;
+		Jobs[(Head + Count) % QueueCapacity] = job;
+		Count++;
+		return true;
+	}
+
+	Job* JobSystem::WorkQueue::Pop()
+	{
+		std::lock_guard lock(Mutex);
+		if (Count == 0)
+			return nullptr;
+		Count--;
+		return Jobs[(Head + Count) % QueueCapacity];
+	}
+
+	Job* JobSystem::WorkQueue::Steal()
+	{
+		std::lock_guard lock(Mutex);
+		if (Count == 0)
+			return nullptr;
+		Job* job = Jobs[Head];
+		Head = (Head + 1) % QueueCapacity;
+		Count--;
+		return job;
+	}
+
+	JobSystem::JobSystem(unsigned threads)
+	{
+		SetThreadCount(threads);
+	}
+
+	void JobSystem::SetThreadCount(unsigned threads)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+
+		Stop();
+		m_Stopping = false;
+		m_Queues = std::make_unique<WorkQueue[]>(threads);
+		m_ThreadCount = threads;
+		m_Workers.reserve(threads - 1);
+		for (unsigned i = 1; i < threads; i++) // the caller is the first thread
+		{
+			m_Workers.emplace_back([this, i] { WorkerLoop(i); });
+		}
+	}
+
+	Job* JobSystem::AllocateJob(const char* name)
+	{
+		// the pool is a ring: by the time it comes around, the old job in the slot should long be done
+		Job* job = &m_Jobs[m_JobCount.fetch_add(1) % MaxJobs];
+		if (job->Function && !job->Finished.load(std::memory_order_acquire))
+			throw std::exception("Job pool exhausted: too many unfinished jobs");
+
+		job->Name = name;
+		job->Pending.store(1); // released by Submit()
+		job->Finished.store(false);
+		job->DependentCount = 0;
+		return job;
+	}
+
+	void JobSystem::DependsOn(Job* job, Job* dependency)
+	{
+		// the dependency may be running already, it hands out its dependents under the same lock
+		std::lock_guard lock(m_DependencyMutex);
+		if (dependency->Finished.load(std::memory_order_acquire))
+			return; // nothing to wait for
+
+		if (dependency->DependentCount == Job::MaxDependents)
+			throw std::exception("Too many dependents on one job");
+
+		dependency->Dependents[dependency->DependentCount++] = job;
+		job->Pending.fetch_add(1);
+	}
+
+	void JobSystem::Submit(Job* job)
+	{
+		if (job->Pending.fetch_sub(1) == 1)
+			Enqueue(job);
+	}
+
+	void JobSystem::Wait(const Job* job)
+	{
+		const unsigned worker = CurrentWorker();
+		while (!job->Finished.load(std::memory_order_acquire))
+		{
+			if (Job* next = FindJob(worker))
+				Execute(next, worker);
+			else
+				std::this_thread::yield(); // what's left is running elsewhere
+		}
+	}
+
+	void JobSystem::Enqueue(Job* job)
+	{
+		const unsigned worker = CurrentWorker();
+		if (!m_Queues[worker].Push(job))
+		{
+			Execute(job, worker); // queue is full, just do it now
+			return;
+		}
+
+		m_Queued.fetch_add(1);
+		{
+			std::lock_guard lock(m_SleepMutex); // sleepers check m_Queued under this mutex, don't lose the wake-up
+		}
+		m_WorkAvailable.notify_one();
+	}
+
+	Job* JobSystem::FindJob(unsigned worker)
+	{
+		Job* job = m_Queues[worker].Pop();
+		for (unsigned i = 1; !job && i < Size(); i++)
+		{
+			job = m_Queues[(worker + i) % Size()].Steal();
+		}
+		if (job)
+			m_Queued.fetch_sub(1);
+		return job;
+	}
+
+	void JobSystem::Execute(Job* job, unsigned worker)
+	{
+		const bool tracing = m_Tracing.load(std::memory_order_relaxed);
+		const auto start = tracing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+		job->Function(job->Body);
+
+		if (tracing)
+		{
+			const size_t index = m_TraceCount.fetch_add(1);
+			if (index < MaxTraceEvents)
+			{
+				const auto end = std::chrono::steady_clock::now();
+				m_Trace[index] = JobTraceEvent{
+					job->Name, worker,
+					std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_TraceStart).count(),
+					std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_TraceStart).count()
+				};
+			}
+		}
+
+		// copy the dependents out first: once Finished is set the slot can be handed to a new job
+		Job* dependents[Job::MaxDependents];
+		size_t dependentCount{};
+		{
+			std::lock_guard lock(m_DependencyMutex);
+			dependentCount = job->DependentCount;
+			std::copy(job->Dependents, job->Dependents + dependentCount, dependents);
+			job->Finished.store(true, std::memory_order_release);
+		}
+
+		for (size_t i = 0; i < dependentCount; i++)
+		{
+			if (dependents[i]->Pending.fetch_sub(1) == 1)
+				Enqueue(dependents[i]);
+		}
+	}
+
+	void JobSystem::WorkerLoop(unsigned worker)
+	{
+		t_Worker = worker;
+		while (true)
+		{
+			if (Job* job = FindJob(worker))
+			{
+				Execute(job, worker);
+				continue;
+			}
+
+			std::unique_lock lock(m_SleepMutex);
+			m_WorkAvailable.wait(lock, [this] { return m_Stopping || m_Queued.load() > 0; });
+			if (m_Stopping)
+				return;
+		}
+	}
+
+	unsigned JobSystem::CurrentWorker() const
+	{
+		return t_Worker < Size() ? t_Worker : 0;
+	}
+
+	void JobSystem::Stop()
+	{
+		{
+			std::lock_guard lock(m_SleepMutex);
+			m_Stopping = true;
+		}
+		m_WorkAvailable.notify_all();
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+		m_Workers.clear();
+		m_ThreadCount = 1;
+	}
+
+	void JobSystem::EnableTrace(bool enable)
+	{
+		if (enable && !m_Trace)
+		{
+			m_Trace = std::make_unique<JobTraceEvent[]>(MaxTraceEvents);
+			m_TraceStart = std::chrono::steady_clock::now();
+		}
+		m_Tracing.store(enable);
+	}
+
+	bool JobSystem::WriteTrace(const char* fileName) const
+	{
+		std::ofstream file(fileName);
+		if (!file)
+			return false;
+
+		const size_t count = std::min(m_TraceCount.load(), m_Trace ? MaxTraceEvents : 0);
+		file << "{\"traceEvents\":[\n";
+		for (size_t i = 0; i < count; i++)
+		{
+			const JobTraceEvent& e = m_Trace[i];
+			file << (i ? ",\n" : "") << "{\"name\":\"" << e.Name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.Worker
+				<< ",\"ts\":" << e.Start / 1000.0 << ",\"dur\":" << (e.End - e.Start) / 1000.0 << "}";
+		}
+		file << "\n]}\n";
+		return true;
+	}
+}
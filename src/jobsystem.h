@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace TG
+{
+	// A unit of work in a frame graph. It runs once every job it depends on has finished.
+	// Created by JobSystem::Create; the pool is recycled in order, a job stays valid for MaxJobs more creations
+	struct Job
+	{
+		constexpr static size_t MaxDependents{ 32 };
+		constexpr static size_t StorageSize{ 64 };
+
+		void (*Function)(void* body){};
+		alignas(std::max_align_t) unsigned char Body[StorageSize]{};
+		const char* Name{};
+
+		std::atomic<int> Pending{ 0 }; // unfinished dependencies, +1 until the job is submitted
+		std::atomic<bool> Finished{ false };
+		Job* Dependents[MaxDependents]{};
+		size_t DependentCount{};
+	};
+
+	struct JobTraceEvent
+	{
+		const char* Name{};
+		unsigned Worker{};
+		long long Start{}; // ns since the trace was enabled
+		long long End{};
+	};
+
+	// Work-stealing job scheduler. Every thread has its own queue: it pushes and pops at the back (the jobs
+	// it just made ready are hot in cache), idle threads steal from the front of the others' queues.
+	// The thread calling Wait() works on jobs too, so nested waits inside jobs don't deadlock
+	class JobSystem
+	{
+	public:
+		// threads counts the calling thread too; 0 means one per hardware thread
+		explicit JobSystem(unsigned threads = 0);
+		JobSystem(const JobSystem& other) = delete;
+		~JobSystem() { Stop(); }
+
+		void SetThreadCount(unsigned threads);
+		// workers + the calling thread
+		unsigned Size() const { return m_ThreadCount; }
+
+		// body has to be small and trivially destructible: capture by reference or small values.
+		// Wire up dependencies (DependsOn) before submitting the job; its dependencies may be running or done already
+		template <typename Body>
+		Job* Create(const char* name, Body&& body)
+		{
+			using BodyType = std::decay_t<Body>;
+			static_assert(sizeof(BodyType) <= Job::StorageSize, "job body too big, capture by reference");
+			static_assert(std::is_trivially_destructible_v<BodyType>, "job bodies are never destructed");
+
+			Job* job = AllocateJob(name);
+			new (job->Body) BodyType(std::forward<Body>(body));
+			job->Function = [](void* storage) { (*static_cast<BodyType*>(storage))(); };
+			return job;
+		}
+
+		void DependsOn(Job* job, Job* dependency);
+		void Submit(Job* job);
+		// runs other jobs while waiting
+		void Wait(const Job* job);
+
+		// calls body(chunk) for every chunk in [0, chunks) and returns once all of them are done
+		template <typename Body>
+		void ParallelFor(size_t chunks, Body&& body)
+		{
+			if (chunks == 0)
+				return;
+			if (chunks == 1 || m_ThreadCount == 1)
+			{
+				for (size_t chunk = 0; chunk < chunks; chunk++)
+					body(chunk);
+				return;
+			}
+
+			// one job per thread pulling chunk indices, not one job per chunk
+			std::atomic<size_t> next{ 0 };
+			const size_t jobs{ std::min<size_t>(chunks, Size()) };
+			Job* join = Create("parallel for join", [] {});
+			for (size_t i = 0; i < jobs; i++)
+			{
+				Job* job = Create("parallel for", [&next, &body, chunks]
+				{
+					for (size_t chunk = next.fetch_add(1); chunk < chunks; chunk = next.fetch_add(1))
+						body(chunk);
+				});
+				DependsOn(join, job);
+				Submit(job);
+			}
+			Submit(join);
+			Wait(join);
+		}
+
+		// job trace for tuning; events past the buffer capacity are dropped
+		void EnableTrace(bool enable);
+		bool WriteTrace(const char* fileName) const; // chrome://tracing / Perfetto JSON
+
+	private:
+		constexpr static size_t MaxJobs{ 1 << 12 };
+		constexpr static size_t QueueCapacity{ 1 << 12 };
+		constexpr static size_t MaxTraceEvents{ 1 << 16 };
+
+		// fixed ring buffer guarded by a mutex: push/pop at the back for the owner, steal at the front
+		struct WorkQueue
+		{
+			std::mutex Mutex{};
+			std::unique_ptr<Job*[]> Jobs{ std::make_unique<Job*[]>(QueueCapacity) };
+			size_t Head{}; // front
+			size_t Count{};
+
+			bool Push(Job* job);
+			Job* Pop();
+			Job* Steal();
+		};
+
+		std::unique_ptr<Job[]> m_Jobs{ std::make_unique<Job[]>(MaxJobs) };
+		std::atomic<size_t> m_JobCount{ 0 }; // jobs created so far, the next one goes to m_JobCount % MaxJobs
+		std::mutex m_DependencyMutex{};
+
+		std::vector<std::thread> m_Workers{};
+		unsigned m_ThreadCount{ 1 }; // set before the workers start, they read it without locking
+		std::unique_ptr<WorkQueue[]> m_Queues{}; // [0] belongs to the calling thread
+		std::mutex m_SleepMutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::atomic<size_t> m_Queued{ 0 }; // jobs sitting in queues
+		bool m_Stopping{ false };
+
+		std::atomic<bool> m_Tracing{ false };
+		std::chrono::steady_clock::time_point m_TraceStart{};
+		std::unique_ptr<JobTraceEvent[]> m_Trace{};
+		std::atomic<size_t> m_TraceCount{ 0 };
+
+	private:
+		Job* AllocateJob(const char* name);
+		void Enqueue(Job* job);
+		Job* FindJob(unsigned worker);
+		void Execute(Job* job, unsigned worker);
+		void WorkerLoop(unsigned worker);
+		unsigned CurrentWorker() const;
+		void Stop();
+	};
+}
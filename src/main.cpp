@@ -1,33 +1,259 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <utility>
+#include <vector>
 #include <conio.h>
 
 #include "tgraphics.h"
+#include "commandbuffer.h"
+#include "scene.h"
 
+static const char* const RasterModeNames[]{ "flat", "smooth", "wireframe", "depth", "edges" };
+
+static TG::RasterMode ParseRasterMode(const char* name)
+{
+	for (size_t i = 0; i < std::size(RasterModeNames); i++)
+	{
+		if (strcmp(name, RasterModeNames[i]) == 0)
+			return static_cast<TG::RasterMode>(i);
+	}
+	return TG::RasterMode::Flat;
+}
+
+static const char* const ColorModeNames[]{ "mono", "256", "truecolor" };
+
+static TG::ColorMode ParseColorMode(const char* name)
+{
+	for (size_t i = 0; i < std::size(ColorModeNames); i++)
+	{
+		if (strcmp(name, ColorModeNames[i]) == 0)
+			return static_cast<TG::ColorMode>(i);
+	}
+	return TG::ColorMode::Mono;
+}
+
+// "r,g,b", 0-255 each; missing parts are 255
+static TG::Rgb ParseRgb(const char* text)
+{
+	int values[3]{ 255, 255, 255 };
+	for (int& value : values)
+	{
+		char* end{};
+		value = std::clamp(static_cast<int>(strtol(text, &end, 10)), 0, 255);
+		if (*end != ',')
+			break;
+		text = end + 1;
+	}
+	return TG::Rgb{ static_cast<uint8_t>(values[0]), static_cast<uint8_t>(values[1]), static_cast<uint8_t>(values[2]) };
+}
+
+// "--name value" options after the model path and read mode
+static const char* GetOption(int argc, char* argv[], const char* name, const char* defaultValue)
+{
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], name) == 0)
+			return argv[i + 1];
+	}
+	return defaultValue;
+}
+
+// every "--light x,y,z[,intensity]" (towards a directional light) and "--point-light x,y,z[,intensity]" (where one
+// is), in view space. Empty if there are none
+static std::vector<TG::Light> ParseLights(int argc, char* argv[])
+{
+	std::vector<TG::Light> lights{};
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		const bool point = strcmp(argv[i], "--point-light") == 0;
+		if (!point && strcmp(argv[i], "--light") != 0)
+			continue;
+		float values[4]{ 0.0f, 0.0f, 0.0f, 1.0f };
+		const char* text = argv[i + 1];
+		for (float& value : values)
+		{
+			char* end{};
+			value = strtof(text, &end);
+			if (*end != ',')
+				break;
+			text = end + 1;
+		}
+		TG::Light light{};
+		light.Type = point ? TG::LightType::Point : TG::LightType::Directional;
+		const TG::Vector3 vector{ values[0], values[1], values[2] };
+		if (point)
+			light.Position = vector;
+		else if (const float length = vector.Length(); length > 0.0f)
+			light.Direction = vector * (1.0f / length);
+		light.Intensity = values[3];
+		lights.push_back(light);
+	}
+	return lights;
+}
 
 int main(int argc, char* argv[])
 {
 	auto fullSize = GetLargestConsoleWindowSize(GetStdHandle(STD_OUTPUT_HANDLE));
 
 	TG::Graphics g{ COORD{360, 120}, argc, argv };
+	g.SetThreadCount(static_cast<unsigned>(atoi(GetOption(argc, argv, "--threads", "0"))));
+	g.SetPipelineDepth(static_cast<unsigned>(atoi(GetOption(argc, argv, "--pipeline", "1"))));
+	g.FrontToBack = strcmp(GetOption(argc, argv, "--order", "back-to-front"), "front-to-back") == 0;
+	g.Raster = ParseRasterMode(GetOption(argc, argv, "--raster", "flat"));
+	g.PerspectiveStep = static_cast<unsigned>(atoi(GetOption(argc, argv, "--perspective-step", "8")));
+	if (std::vector<TG::Light> lights = ParseLights(argc, argv); !lights.empty())
+		g.Lights = std::move(lights);
+	if (const char* charset = GetOption(argc, argv, "--charset", "utf8"); strcmp(charset, "cp437") == 0)
+		g.SetGlyphEncoding(TG::GlyphEncoding::Cp437);
+	else if (strcmp(charset, "ascii") == 0)
+		g.SetGlyphEncoding(TG::GlyphEncoding::Ascii);
+	if (const TG::ColorMode colors = ParseColorMode(GetOption(argc, argv, "--color", "mono")); colors != TG::ColorMode::Mono)
+		g.SetColorMode(colors, ParseRgb(GetOption(argc, argv, "--model-color", "255,255,255")),
+		               static_cast<unsigned>(atoi(GetOption(argc, argv, "--color-levels", "16"))));
+	const char* traceFile = GetOption(argc, argv, "--trace", nullptr);
+	g.EnableJobTrace(traceFile != nullptr);
 
-	typedef std::chrono::high_resolution_clock clock;
-	std::chrono::steady_clock::time_point begin{};
-	std::chrono::steady_clock::time_point end{};
-	std::chrono::duration<float> elapsed{};
+	if (const int benchFrames = atoi(GetOption(argc, argv, "--bench", "0")); benchFrames > 0)
+	{
+		// every raster kernel on the same frame: a recording, or the model as it's shown at the start
+		const char* replayFile = GetOption(argc, argv, "--replay", nullptr);
+		TG::CommandBuffer commands{};
+		if (replayFile)
+			commands = TG::CommandBuffer::Load(replayFile);
+		else
+			g.RecordScene(commands);
+		for (size_t mode = 0; mode < std::size(RasterModeNames); mode++)
+		{
+			for (const bool frontToBack : { false, true })
+			{
+				g.Raster = static_cast<TG::RasterMode>(mode);
+				if (frontToBack && g.Raster == TG::RasterMode::Edges) // lines aren't sorted, there's no order
+					continue;
+				g.FrontToBack = frontToBack;
+				float rasterTime{ 0.0f };
+				for (int i = 0; i < benchFrames; i++)
+				{
+					g.Submit(&commands);
+					rasterTime += g.GetRasterStats().Time;
+				}
+				std::cerr << RasterModeNames[mode] << (frontToBack ? " front-to-back: " : " back-to-front: ")
+				          << rasterTime * 1000.0f / benchFrames << "ms raster, overdraw " << g.GetRasterStats().Overdraw() << std::endl;
+			}
+		}
+		return 0;
+	}
+
+	if (const char* replayFile = GetOption(argc, argv, "--replay", nullptr))
+	{
+		// raster benchmark: one recorded frame submitted over and over, no simulation and no frame pacing
+		const TG::CommandBuffer commands = TG::CommandBuffer::Load(replayFile);
+		const int frames = std::max(1, atoi(GetOption(argc, argv, "--frames", "100")));
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++)
+		{
+			g.Submit(&commands);
+		}
+		const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << frames << " frames in " << seconds << "s, " << seconds * 1000.0f / frames << "ms per frame" << std::endl;
+		return 0;
+	}
+	const char* recordFile = GetOption(argc, argv, "--record", nullptr);
+
+	// --objects: a grid of copies of the model, each spinning on its own, culled and drawn through a Scene.
+	// --instances: the same grid as one instanced draw, culled per instance by the renderer
+	const int instanceCount = atoi(GetOption(argc, argv, "--instances", "0"));
+	const int objectCount = instanceCount > 0 ? instanceCount : atoi(GetOption(argc, argv, "--objects", "0"));
+	TG::Scene scene{};
+	std::vector<TG::Scene::ObjectId> objects{};
+	std::vector<TG::Vector3> positions{};
+	std::vector<TG::Matrix4> instances{};
+	TG::CommandBuffer commands{};
+	float sceneAngle{ 0.0f };
+	if (objectCount > 0)
+	{
+		const TG::Bounds& box = scene.MeshBounds(g.Model);
+		const float spacing = 1.5f * std::max(box.Max.x - box.Min.x, box.Max.y - box.Min.y);
+		const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(objectCount))));
+		for (int i = 0; i < objectCount; i++)
+		{
+			positions.push_back(TG::Vector3{ (i % side - side / 2) * spacing, (i / side - side / 2) * spacing, 0.0f });
+			if (instanceCount == 0)
+				objects.push_back(scene.Add(g.Model, TG::ObjectTransform(positions.back(), 0.0f)));
+		}
+		instances.resize(instanceCount);
+	}
+
+	TG::FrameScheduler scheduler{ static_cast<float>(atof(GetOption(argc, argv, "--fps", "60"))) };
 	
 	while (true)
 	{
-		begin = clock::now();
-		g.Draw(elapsed.count());
-		end = clock::now();
-		elapsed = (end - begin);
+		for (int steps = scheduler.BeginFrame(); steps > 0; steps--)
+		{
+			g.Update(scheduler.Step());
+			if (!g.Paused)
+				sceneAngle += scheduler.Step();
+		}
+
+		if (instanceCount > 0)
+		{
+			for (size_t i = 0; i < instances.size(); i++)
+			{
+				instances[i] = TG::ObjectTransform(positions[i], sceneAngle + i * 0.1f);
+			}
+			commands.Reset();
+			commands.DrawInstanced(g.Model, instances.data(), instances.size());
+			g.Submit(&commands, 1, scheduler.Timing());
+		}
+		else if (objectCount > 0)
+		{
+			for (size_t i = 0; i < objects.size(); i++)
+			{
+				scene.SetTransform(objects[i], TG::ObjectTransform(positions[i], sceneAngle + i * 0.1f));
+			}
+			const COORD screen = g.GetScreenSize();
+			commands.Reset();
+			scene.Record(TG::Frustum::FromCamera(g.View, screen.X, screen.Y), commands);
+			g.Submit(&commands, 1, scheduler.Timing());
+		}
+		else
+		{
+			g.Draw(scheduler.Timing());
+		}
 
 		if(_kbhit()) 
 		{
-			break;
+			int key = _getch();
+			// pause/resume rotation, 'o' switches the raster order, 'r' the raster mode, any other key quits
+			if (key == ' ' || key == 'p')
+				g.Paused = !g.Paused;
+			else if (key == 'o')
+				g.FrontToBack = !g.FrontToBack;
+			else if (key == 'r')
+				g.Raster = static_cast<TG::RasterMode>((static_cast<size_t>(g.Raster) + 1) % std::size(RasterModeNames));
+			else
+				break;
+		}
+
+		scheduler.EndFrame();
+	}
+
+	if (recordFile)
+	{
+		if (objectCount == 0) // a scene has its last frame's commands already
+		{
+			commands.Reset();
+			g.RecordScene(commands);
 		}
+		if (!commands.Save(recordFile))
+			std::cerr << "Can't write recording to " << recordFile << std::endl;
 	}
+	if (traceFile && !g.WriteJobTrace(traceFile))
+		std::cerr << "Can't write job trace to " << traceFile << std::endl;
 
 	return 0;
 }
\ No newline at end of file
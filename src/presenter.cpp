@@ -0,0 +1,300 @@
+#include "presenter.h"
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace TG
+{
+	void FrameBuffer::Resize(short width, short height)
+	{
+		m_Width = width;
+		m_Height = height;
+		m_Cells.assign(static_cast<size_t>(width) * height, Glyph{ ' ' });
+		m_Colors.assign(m_Cells.size(), DefaultColors);
+	}
+
+	void FrameBuffer::Clear(Glyph filler)
+	{
+		std::fill(m_Cells.begin(), m_Cells.end(), filler);
+		std::fill(m_Colors.begin(), m_Colors.end(), DefaultColors);
+	}
+
+	// the xterm 256 color nearest to color: the 6x6x6 cube or the gray ramp
+	static int Palette256(Rgb color)
+	{
+		auto cubeStep = [](int value) { return value < 48 ? 0 : value < 115 ? 1 : (value - 35) / 40; };
+		auto cubeValue = [](int step) { return step == 0 ? 0 : 55 + step * 40; };
+		auto distance = [color](int r, int g, int b)
+		{
+			return (color.R - r) * (color.R - r) + (color.G - g) * (color.G - g) + (color.B - b) * (color.B - b);
+		};
+		const int r{ cubeStep(color.R) };
+		const int g{ cubeStep(color.G) };
+		const int b{ cubeStep(color.B) };
+		const int gray{ std::clamp(((color.R + color.G + color.B) / 3 - 3) / 10, 0, 23) };
+		const int grayValue{ 8 + gray * 10 };
+		if (distance(grayValue, grayValue, grayValue) < distance(cubeValue(r), cubeValue(g), cubeValue(b)))
+			return 232 + gray;
+		return 16 + r * 36 + g * 6 + b;
+	}
+
+	void FrameBuffer::Text(int x, int y, const char* text)
+	{
+		for (; *text != '\0' && x < m_Width; text++, x++)
+		{
+			Set(x, y, AsciiGlyph(*text));
+		}
+	}
+
+	Presenter::~Presenter()
+	{
+		RestoreOutput();
+	}
+
+	void Presenter::SetOutput(HANDLE output)
+	{
+		RestoreOutput();
+		m_Output = output;
+		m_NonBlocking = false;
+		m_InFlightCells.clear(); // unknown screen contents, next frame is sent in full
+		m_InFlightColors.clear();
+
+		if (GetFileType(output) == FILE_TYPE_PIPE) // ssh sessions, redirected output
+		{
+			DWORD mode{ PIPE_READMODE_BYTE | PIPE_NOWAIT };
+			m_NonBlocking = SetNamedPipeHandleState(output, &mode, nullptr, nullptr) != FALSE;
+		}
+	}
+
+	void Presenter::SetEncoding(GlyphEncoding encoding)
+	{
+		m_Glyphs = GlyphTable(encoding);
+		m_InFlightCells.clear(); // the same glyphs are different bytes now
+		m_LatestCells.clear();
+	}
+
+	void Presenter::SetColors(ColorMode mode, const ColorPairRgb* pairs, size_t count)
+	{
+		m_ResetColors = m_ResetColors || !m_Colors.empty();
+		m_Colors.clear();
+		m_InFlightCells.clear();
+		m_LatestCells.clear();
+		if (mode == ColorMode::Mono)
+			return;
+
+		m_ResetColors = false; // every row sets its colors before its first cell
+		m_Colors.resize(std::size(m_SameColors));
+		for (size_t pair = 0; pair < m_Colors.size(); pair++)
+		{
+			EncodedColors& encoded = m_Colors[pair];
+			int len{};
+			if (pair == DefaultColors || pair > count)
+			{
+				len = snprintf(encoded.Bytes, MaxColorBytes, "\x1b[39;49m");
+			}
+			else if (const ColorPairRgb& colors = pairs[pair - 1]; mode == ColorMode::Palette256)
+			{
+				len = snprintf(encoded.Bytes, MaxColorBytes, "\x1b[38;5;%d;48;5;%dm", Palette256(colors.Foreground),
+				               Palette256(colors.Background));
+			}
+			else
+			{
+				len = snprintf(encoded.Bytes, MaxColorBytes, "\x1b[38;2;%d;%d;%d;48;2;%d;%d;%dm", colors.Foreground.R,
+				               colors.Foreground.G, colors.Foreground.B, colors.Background.R, colors.Background.G,
+				               colors.Background.B);
+			}
+			encoded.Size = static_cast<uint8_t>(len);
+
+			// pairs the palette maps to the same colors make one run
+			m_SameColors[pair] = static_cast<ColorPair>(pair);
+			for (size_t same = 0; same < pair; same++)
+			{
+				if (m_Colors[same].Size == encoded.Size && std::memcmp(m_Colors[same].Bytes, encoded.Bytes, encoded.Size) == 0)
+				{
+					m_SameColors[pair] = static_cast<ColorPair>(same);
+					break;
+				}
+			}
+		}
+	}
+
+	void Presenter::Present(const FrameBuffer& frame)
+	{
+		if (!Write()) // output is still busy with an older frame
+		{
+			if (m_HasLatest)
+				m_Stats.DroppedFrames++; // it never left the process
+
+			// diff against the in-flight frame: that's what the terminal shows once it drains
+			Encode(frame, m_InFlightCells, m_InFlightColors, m_Latest);
+			m_HasLatest = !m_Latest.empty();
+			if (m_HasLatest)
+				KeepCells(frame, m_LatestCells, m_LatestColors);
+			UpdateQueuedBytes();
+			return;
+		}
+
+		Encode(frame, m_InFlightCells, m_InFlightColors, m_InFlight);
+		m_InFlightOffset = 0;
+		if (!m_InFlight.empty()) // identical frames cost nothing
+		{
+			KeepCells(frame, m_InFlightCells, m_InFlightColors);
+			m_ResetColors = false;
+			m_Stats.PresentedFrames++;
+			Write();
+		}
+		UpdateQueuedBytes();
+	}
+
+	bool Presenter::Poll()
+	{
+		bool drained = Write();
+		UpdateQueuedBytes();
+		return drained;
+	}
+
+	void Presenter::Encode(const FrameBuffer& frame, const std::vector<Glyph>& base, const std::vector<ColorPair>& baseColors,
+	                       std::string& out)
+	{
+		out.clear();
+		const bool full = base.size() != frame.Cells().size() || (!m_Colors.empty() && baseColors.size() != base.size());
+		if (m_ResetColors)
+			out.append("\x1b[0m");
+		if (!m_Jobs || frame.Height() < 2 * EncodeBandRows)
+		{
+			EncodeRows(frame, base, baseColors, full, 0, frame.Height(), out);
+			return;
+		}
+
+		// rows are independent: encode bands in parallel, then stitch them together in order
+		const size_t bands = (frame.Height() + EncodeBandRows - 1) / EncodeBandRows;
+		if (m_BandBytes.size() < bands)
+			m_BandBytes.resize(bands);
+		m_Jobs->ParallelFor(bands, [&](size_t band)
+		{
+			const short first = static_cast<short>(band * EncodeBandRows);
+			const short end = std::min<short>(static_cast<short>(first + EncodeBandRows), frame.Height());
+			m_BandBytes[band].clear();
+			EncodeRows(frame, base, baseColors, full, first, end, m_BandBytes[band]);
+		});
+		for (size_t band = 0; band < bands; band++)
+		{
+			out.append(m_BandBytes[band]);
+		}
+	}
+
+	void Presenter::EncodeRows(const FrameBuffer& frame, const std::vector<Glyph>& base,
+	                           const std::vector<ColorPair>& baseColors, bool full, short firstRow, short endRow,
+	                           std::string& out) const
+	{
+		const bool colored = !m_Colors.empty();
+		const size_t cellBytes = MaxGlyphBytes + (colored ? MaxColorBytes : 0);
+		// cursor moves keep the colors: they carry on from one row to the next. Only what came before the band is
+		// unknown, it's encoded by another job
+		int current{ -1 };
+		char cup[16]{};
+		for (short y = firstRow; y < endRow; y++)
+		{
+			const Glyph* row = frame.Row(y);
+			const ColorPair* colors = frame.ColorRow(y);
+			if (!full && std::memcmp(row, base.data() + y * frame.Width(), frame.Width()) == 0 &&
+			    (!colored || std::memcmp(colors, baseColors.data() + y * frame.Width(), frame.Width()) == 0))
+				continue; // row already on screen
+
+			// absolute positioning per row, so a short write never shifts the rest of the screen.
+			// Room for the longest glyphs and colors up front, then every cell is fixed size copies
+			int len = snprintf(cup, sizeof(cup), "\x1b[%d;1H", y + 1);
+			const size_t start = out.size();
+			out.resize(start + len + static_cast<size_t>(frame.Width()) * cellBytes);
+			char* write = out.data() + start;
+			std::memcpy(write, cup, len);
+			write += len;
+			for (short x = 0; x < frame.Width(); x++)
+			{
+				if (colored)
+				{
+					// a run of cells in the same colors is one SGR sequence, like curses groups a line by attribute
+					if (const ColorPair pair = m_SameColors[colors[x]]; pair != current)
+					{
+						const EncodedColors& encoded = m_Colors[pair];
+						std::memcpy(write, encoded.Bytes, MaxColorBytes);
+						write += encoded.Size;
+						current = pair;
+					}
+				}
+				const EncodedGlyph& glyph = m_Glyphs[row[x]];
+				std::memcpy(write, glyph.Bytes, MaxGlyphBytes);
+				write += glyph.Size;
+			}
+			out.resize(write - out.data());
+		}
+	}
+
+	void Presenter::KeepCells(const FrameBuffer& frame, std::vector<Glyph>& cells, std::vector<ColorPair>& colors) const
+	{
+		cells = frame.Cells();
+		if (m_Colors.empty())
+			colors.clear();
+		else
+			colors = frame.Colors();
+	}
+
+	bool Presenter::Write()
+	{
+		while (true)
+		{
+			while (m_InFlightOffset < m_InFlight.size())
+			{
+				if (m_Output == INVALID_HANDLE_VALUE)
+				{
+					m_InFlightOffset = m_InFlight.size(); // nowhere to write, act like a sink
+					break;
+				}
+
+				DWORD written{};
+				const DWORD toWrite = static_cast<DWORD>(m_InFlight.size() - m_InFlightOffset);
+				if (!WriteFile(m_Output, m_InFlight.data() + m_InFlightOffset, toWrite, &written, nullptr))
+				{
+					// broken output: drop everything queued, don't spin on it. Screen contents are unknown now
+					m_InFlightOffset = m_InFlight.size();
+					m_InFlightCells.clear();
+					m_InFlightColors.clear();
+					m_HasLatest = false;
+					break;
+				}
+
+				m_InFlightOffset += written;
+				if (written < toWrite && m_NonBlocking) // pipe is full, try again next time
+					return false;
+			}
+
+			if (!m_HasLatest)
+				return true;
+
+			// in-flight frame is done, the newest queued frame goes next
+			std::swap(m_InFlight, m_Latest);
+			std::swap(m_InFlightCells, m_LatestCells);
+			std::swap(m_InFlightColors, m_LatestColors);
+			m_InFlightOffset = 0;
+			m_HasLatest = false;
+			m_Stats.PresentedFrames++;
+		}
+	}
+
+	void Presenter::RestoreOutput()
+	{
+		if (m_NonBlocking) // leave the pipe the way we found it
+		{
+			DWORD mode{ PIPE_READMODE_BYTE | PIPE_WAIT };
+			SetNamedPipeHandleState(m_Output, &mode, nullptr, nullptr);
+			m_NonBlocking = false;
+		}
+	}
+
+	void Presenter::UpdateQueuedBytes()
+	{
+		m_Stats.QueuedBytes = (m_InFlight.size() - m_InFlightOffset) + (m_HasLatest ? m_Latest.size() : 0);
+	}
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <Windows.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "glyph.h"
+
+namespace TG
+{
+	class JobSystem;
+
+	// a cell's colors, as an index into the presenter's table of color pairs like a curses color pair,
+	// so a cell is one more byte instead of two colors. 0 is the terminal's own colors
+	using ColorPair = uint8_t;
+	constexpr ColorPair DefaultColors{ 0 };
+
+	struct Rgb
+	{
+		uint8_t R, G, B;
+	};
+
+	struct ColorPairRgb
+	{
+		Rgb Foreground;
+		Rgb Background;
+	};
+
+	enum class ColorMode
+	{
+		Mono, // glyphs only, cell colors aren't sent
+		Palette256, // the nearest of the xterm 256 colors
+		TrueColor // 24-bit colors as they are
+	};
+
+	// Screen-sized grid of cells. The rasterizer writes here instead of talking to the console directly
+	class FrameBuffer
+	{
+	public:
+		FrameBuffer() = default;
+		FrameBuffer(short width, short height) { Resize(width, height); }
+
+		void Resize(short width, short height);
+		void Clear(Glyph filler = ' ');
+
+		void Set(int x, int y, Glyph filler, ColorPair colors = DefaultColors)
+		{
+			if (x < 0 || y < 0 || x >= m_Width || y >= m_Height)
+				return;
+			m_Cells[y * m_Width + x] = filler;
+			m_Colors[y * m_Width + x] = colors;
+		}
+
+		// overlay text (ASCII only) in the default colors, clipped at the right edge
+		void Text(int x, int y, const char* text);
+
+		Glyph At(int x, int y) const { return m_Cells[y * m_Width + x]; }
+		ColorPair ColorsAt(int x, int y) const { return m_Colors[y * m_Width + x]; }
+		const Glyph* Row(int y) const { return m_Cells.data() + y * m_Width; }
+		const ColorPair* ColorRow(int y) const { return m_Colors.data() + y * m_Width; }
+		void SetRow(int y, const Glyph* cells, const ColorPair* colors)
+		{
+			std::copy(cells, cells + m_Width, m_Cells.data() + y * m_Width);
+			std::copy(colors, colors + m_Width, m_Colors.data() + y * m_Width);
+		}
+		const std::vector<Glyph>& Cells() const { return m_Cells; }
+		const std::vector<ColorPair>& Colors() const { return m_Colors; }
+		short Width() const { return m_Width; }
+		short Height() const { return m_Height; }
+
+	private:
+		short m_Width{};
+		short m_Height{};
+		std::vector<Glyph> m_Cells{};
+		std::vector<ColorPair> m_Colors{}; // next to the glyphs, one per cell
+	};
+
+	struct PresentStats
+	{
+		unsigned long long PresentedFrames{}; // frames that started going out to the terminal
+		unsigned long long DroppedFrames{}; // frames replaced by a newer one before they were sent
+		size_t QueuedBytes{}; // bytes encoded but not yet accepted by the output
+	};
+
+	// Encodes frames to VT sequences and writes them without letting a slow terminal stall the render loop.
+	// Only one frame is in flight at a time; while it drains, newer frames overwrite a single "latest" slot,
+	// so the frame that gets sent next is always the newest one.
+	// Only rows that differ from what the terminal will be showing are encoded. In color, a row is runs of cells
+	// of the same colors: an SGR sequence goes out where the colors change, not per cell.
+	class Presenter
+	{
+	public:
+		Presenter() = default;
+		Presenter(const Presenter& other) = delete;
+		~Presenter();
+
+		// output isn't owned. Pipes are switched to non-blocking mode, anything else is written synchronously
+		void SetOutput(HANDLE output);
+		// encode bands of rows in parallel; jobs must outlive the presenter or be reset to nullptr
+		void SetJobSystem(JobSystem* jobs) { m_Jobs = jobs; }
+		// what glyphs are sent as; the next frame goes out in full
+		void SetEncoding(GlyphEncoding encoding);
+		// what cell colors are sent as: pairs[i] is ColorPair i + 1, pairs past count show in the default colors.
+		// Mono sends none. The next frame goes out in full
+		void SetColors(ColorMode mode, const ColorPairRgb* pairs, size_t count);
+
+		void Present(const FrameBuffer& frame);
+		// try to drain queued bytes without presenting a new frame
+		bool Poll();
+
+		const PresentStats& Stats() const { return m_Stats; }
+
+	private:
+		HANDLE m_Output{ INVALID_HANDLE_VALUE };
+		bool m_NonBlocking{ false };
+
+		std::string m_InFlight{};
+		size_t m_InFlightOffset{};
+		std::vector<Glyph> m_InFlightCells{}; // screen contents once m_InFlight is written
+		std::vector<ColorPair> m_InFlightColors{}; // empty in mono
+		std::string m_Latest{};
+		std::vector<Glyph> m_LatestCells{};
+		std::vector<ColorPair> m_LatestColors{};
+		bool m_HasLatest{ false };
+
+		PresentStats m_Stats{};
+		const EncodedGlyph* m_Glyphs{ GlyphTable(GlyphEncoding::Utf8) };
+
+		// the SGR sequence that sets a pair's colors, padded like EncodedGlyph
+		constexpr static size_t MaxColorBytes{ 40 };
+		struct EncodedColors
+		{
+			char Bytes[MaxColorBytes];
+			uint8_t Size;
+		};
+		std::vector<EncodedColors> m_Colors{}; // indexed by ColorPair, empty in mono
+		ColorPair m_SameColors[256]{}; // the first pair sent as the same bytes, runs don't break between them
+		bool m_ResetColors{ false }; // back from color: the terminal's SGR state is still the last pair's
+
+		JobSystem* m_Jobs{};
+		std::vector<std::string> m_BandBytes{};
+		constexpr static short EncodeBandRows{ 16 };
+
+	private:
+		void Encode(const FrameBuffer& frame, const std::vector<Glyph>& base, const std::vector<ColorPair>& baseColors,
+		            std::string& out);
+		void EncodeRows(const FrameBuffer& frame, const std::vector<Glyph>& base, const std::vector<ColorPair>& baseColors,
+		                bool full, short firstRow, short endRow, std::string& out) const;
+		void KeepCells(const FrameBuffer& frame, std::vector<Glyph>& cells, std::vector<ColorPair>& colors) const;
+		bool Write(); // true when the in-flight frame is fully written
+		void UpdateQueuedBytes();
+		void RestoreOutput();
+	};
+}
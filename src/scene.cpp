@@ -0,0 +1,285 @@
+#include "scene.h"
+#include "commandbuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TG
+{
+	Matrix4 ObjectTransform(const Vector3& position, float angle)
+	{
+		return Matrix4{
+			{
+				{cosf(angle), -sinf(angle), 0, 0},
+				{sinf(angle), cosf(angle), 0, 0},
+				{0, 0, 1, 0},
+				{position.x, position.y, position.z, 1},
+			}
+		};
+	}
+
+	const Bounds& Scene::MeshBounds(const Mesh& mesh)
+	{
+		CachedBounds& cached = m_MeshBounds[&mesh];
+		if (cached.Version == mesh.Version && cached.Version != 0)
+			return cached.Box;
+
+		cached = CachedBounds{ mesh.Version, BoundsOf(mesh) };
+		return cached.Box;
+	}
+
+	Scene::ObjectId Scene::Add(const Mesh& mesh, const Matrix4& transform)
+	{
+		ObjectId id{};
+		if (!m_FreeIds.empty())
+		{
+			id = m_FreeIds.back();
+			m_FreeIds.pop_back();
+		}
+		else
+		{
+			id = static_cast<ObjectId>(m_Objects.size());
+			m_Objects.emplace_back();
+		}
+
+		Object& object = m_Objects[id];
+		object.Source = &mesh;
+		object.Transform = transform;
+		object.LocalBounds = MeshBounds(mesh);
+		object.WorldBounds = TransformBounds(object.LocalBounds, transform);
+		object.Leaf = NoNode;
+		object.Alive = true;
+		object.Moved = false;
+		m_NeedsRebuild = true;
+		return id;
+	}
+
+	void Scene::Remove(ObjectId id)
+	{
+		m_Objects[id].Alive = false;
+		m_FreeIds.push_back(id);
+		m_NeedsRebuild = true;
+	}
+
+	void Scene::SetTransform(ObjectId id, const Matrix4& transform)
+	{
+		Object& object = m_Objects[id];
+		object.Transform = transform;
+		object.WorldBounds = TransformBounds(object.LocalBounds, transform);
+		if (!object.Moved)
+		{
+			object.Moved = true;
+			m_MovedIds.push_back(id);
+		}
+	}
+
+	void Scene::UpdateIndex()
+	{
+		m_Stats.Rebuilt = false;
+		if (!m_NeedsRebuild && !m_MovedIds.empty())
+		{
+			Refit();
+			// refit boxes only grow apart as objects move; once that costs too much, start over
+			if (TreeCost() > m_BuildCost * RebuildCostRatio)
+				m_NeedsRebuild = true;
+		}
+		if (m_NeedsRebuild)
+			Rebuild();
+
+		for (ObjectId id : m_MovedIds)
+		{
+			m_Objects[id].Moved = false;
+		}
+		m_MovedIds.clear();
+	}
+
+	void Scene::Rebuild()
+	{
+		m_LeafObjects.clear();
+		for (ObjectId id = 0; id < m_Objects.size(); id++)
+		{
+			if (m_Objects[id].Alive)
+				m_LeafObjects.push_back(id);
+		}
+
+		m_Nodes.clear();
+		m_Nodes.reserve(m_LeafObjects.size() * 2);
+		if (!m_LeafObjects.empty())
+		{
+			m_Nodes.emplace_back();
+			BuildNode(0, 0, m_LeafObjects.size());
+		}
+
+		m_BuildCost = TreeCost();
+		m_NeedsRebuild = false;
+		m_Stats.Rebuilt = true;
+	}
+
+	// fills m_Nodes[node] with m_LeafObjects[begin, end): median split along the widest axis of the centers
+	void Scene::BuildNode(uint32_t node, size_t begin, size_t end)
+	{
+		Bounds box = m_Objects[m_LeafObjects[begin]].WorldBounds;
+		Bounds centers{};
+		for (size_t i = begin; i < end; i++)
+		{
+			const Bounds& objectBox = m_Objects[m_LeafObjects[i]].WorldBounds;
+			const Vector3 center{ (objectBox.Min.x + objectBox.Max.x) * 0.5f, (objectBox.Min.y + objectBox.Max.y) * 0.5f,
+			                      (objectBox.Min.z + objectBox.Max.z) * 0.5f };
+			box.Expand(objectBox);
+			if (i == begin)
+				centers = Bounds{ center, center };
+			else
+				centers.Expand(Bounds{ center, center });
+		}
+		m_Nodes[node].Box = box;
+
+		if (end - begin <= MaxLeafObjects)
+		{
+			m_Nodes[node].First = static_cast<uint32_t>(begin);
+			m_Nodes[node].Count = static_cast<uint32_t>(end - begin);
+			for (size_t i = begin; i < end; i++)
+			{
+				m_Objects[m_LeafObjects[i]].Leaf = node;
+			}
+			return;
+		}
+
+		const float spread[3]{ centers.Max.x - centers.Min.x, centers.Max.y - centers.Min.y, centers.Max.z - centers.Min.z };
+		const int axis = spread[0] >= spread[1] && spread[0] >= spread[2] ? 0 : (spread[1] >= spread[2] ? 1 : 2);
+		auto centerOf = [this, axis](ObjectId id)
+		{
+			const Bounds& b = m_Objects[id].WorldBounds;
+			return axis == 0 ? b.Min.x + b.Max.x : (axis == 1 ? b.Min.y + b.Max.y : b.Min.z + b.Max.z);
+		};
+		const size_t middle = begin + (end - begin) / 2;
+		std::nth_element(m_LeafObjects.begin() + begin, m_LeafObjects.begin() + middle, m_LeafObjects.begin() + end,
+		                 [&centerOf](ObjectId a, ObjectId b) { return centerOf(a) < centerOf(b); });
+
+		const uint32_t left = static_cast<uint32_t>(m_Nodes.size());
+		m_Nodes.emplace_back();
+		m_Nodes.emplace_back();
+		m_Nodes[left].Parent = node;
+		m_Nodes[left + 1].Parent = node;
+		m_Nodes[node].First = left;
+		m_Nodes[node].Count = 0;
+		BuildNode(left, begin, middle);
+		BuildNode(left + 1, middle, end);
+	}
+
+	void Scene::Refit()
+	{
+		for (ObjectId id : m_MovedIds)
+		{
+			// recompute the leaf, then its ancestors until a box comes out unchanged: everything above is still right
+			uint32_t node = m_Objects[id].Leaf;
+			while (node != NoNode)
+			{
+				Node& current = m_Nodes[node];
+				Bounds box{};
+				if (current.Count > 0)
+				{
+					box = m_Objects[m_LeafObjects[current.First]].WorldBounds;
+					for (uint32_t i = 1; i < current.Count; i++)
+						box.Expand(m_Objects[m_LeafObjects[current.First + i]].WorldBounds);
+				}
+				else
+				{
+					box = m_Nodes[current.First].Box;
+					box.Expand(m_Nodes[current.First + 1].Box);
+				}
+
+				if (box == current.Box)
+					break;
+				current.Box = box;
+				node = current.Parent;
+			}
+		}
+	}
+
+	float Scene::TreeCost() const
+	{
+		float cost{ 0.0f };
+		for (const Node& node : m_Nodes)
+		{
+			cost += node.Box.SurfaceArea();
+		}
+		return cost;
+	}
+
+	void Scene::AddSubtree(uint32_t node, std::vector<ObjectId>& visible) const
+	{
+		const Node& current = m_Nodes[node];
+		if (current.Count > 0)
+		{
+			visible.insert(visible.end(), m_LeafObjects.begin() + current.First, m_LeafObjects.begin() + current.First + current.Count);
+			return;
+		}
+		AddSubtree(current.First, visible);
+		AddSubtree(current.First + 1, visible);
+	}
+
+	void Scene::Cull(const Frustum& frustum, std::vector<ObjectId>& visible)
+	{
+		UpdateIndex();
+		visible.clear();
+		m_Stats.Objects = Size();
+		m_Stats.NodesVisited = 0;
+		if (m_Nodes.empty())
+		{
+			m_Stats.Visible = 0;
+			return;
+		}
+
+		// planes are dropped from the mask once a node is fully inside them, its children can't cross them
+		constexpr unsigned AllPlanes{ (1u << 6) - 1 };
+		m_CullStack.clear();
+		m_CullStack.emplace_back(0, AllPlanes);
+		while (!m_CullStack.empty())
+		{
+			const auto [node, planes] = m_CullStack.back();
+			m_CullStack.pop_back();
+			m_Stats.NodesVisited++;
+
+			const Bounds& box = m_Nodes[node].Box;
+			unsigned remaining{ planes };
+			bool outside{ false };
+			for (int i = 0; i < 6 && !outside; i++)
+			{
+				if (!(planes & (1u << i)))
+					continue;
+				const Plane& plane = frustum.Planes[i];
+				// the corner furthest along the normal decides "outside", the nearest one "fully inside"
+				const Vector3 farCorner{ plane.Normal.x >= 0 ? box.Max.x : box.Min.x, plane.Normal.y >= 0 ? box.Max.y : box.Min.y,
+				                   plane.Normal.z >= 0 ? box.Max.z : box.Min.z };
+				const Vector3 nearCorner{ plane.Normal.x >= 0 ? box.Min.x : box.Max.x, plane.Normal.y >= 0 ? box.Min.y : box.Max.y,
+				                    plane.Normal.z >= 0 ? box.Min.z : box.Max.z };
+				if (DotProduct(plane.Normal, farCorner) + plane.D < 0.0f)
+					outside = true;
+				else if (DotProduct(plane.Normal, nearCorner) + plane.D >= 0.0f)
+					remaining &= ~(1u << i);
+			}
+			if (outside)
+				continue;
+
+			const Node& current = m_Nodes[node];
+			if (remaining == 0 || current.Count > 0)
+			{
+				AddSubtree(node, visible); // leaves aren't split any further, their objects are close enough
+				continue;
+			}
+			m_CullStack.emplace_back(current.First + 1, remaining);
+			m_CullStack.emplace_back(current.First, remaining);
+		}
+		m_Stats.Visible = visible.size();
+	}
+
+	void Scene::Record(const Frustum& frustum, CommandBuffer& commands)
+	{
+		Cull(frustum, m_Visible);
+		for (ObjectId id : m_Visible)
+		{
+			commands.SetTransform(m_Objects[id].Transform);
+			commands.DrawMesh(*m_Objects[id].Source);
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tgraphics.h"
+
+namespace TG
+{
+	class CommandBuffer;
+
+	// rotation around z, then translation: the usual placement of an object
+	Matrix4 ObjectTransform(const Vector3& position, float angle);
+
+	struct SceneStats
+	{
+		size_t Objects{};
+		size_t Visible{};
+		size_t NodesVisited{};
+		bool Rebuilt{}; // the index was rebuilt from scratch this frame instead of refit
+	};
+
+	// Objects with their own transform, indexed by a BVH over world-space bounds.
+	// Moving an object only refits the boxes above it; adding or removing objects, or refits that let the
+	// tree degrade too far, rebuild it. Cull() brings the index up to date first, then only walks nodes that
+	// can intersect the frustum; subtrees entirely inside are taken without testing their objects.
+	// Meshes are referenced, not copied
+	class Scene
+	{
+	public:
+		using ObjectId = uint32_t;
+
+		ObjectId Add(const Mesh& mesh, const Matrix4& transform);
+		void Remove(ObjectId id);
+		void SetTransform(ObjectId id, const Matrix4& transform);
+		const Matrix4& Transform(ObjectId id) const { return m_Objects[id].Transform; }
+		const Bounds& WorldBounds(ObjectId id) const { return m_Objects[id].WorldBounds; }
+		size_t Size() const { return m_Objects.size() - m_FreeIds.size(); }
+
+		// ids of the objects whose bounds may intersect the frustum
+		void Cull(const Frustum& frustum, std::vector<ObjectId>& visible);
+		// culls, then records SetTransform + DrawMesh for every visible object
+		void Record(const Frustum& frustum, CommandBuffer& commands);
+
+		// BoundsOf(mesh), cached per mesh version
+		const Bounds& MeshBounds(const Mesh& mesh);
+		const SceneStats& Stats() const { return m_Stats; }
+
+	private:
+		constexpr static uint32_t NoNode{ UINT32_MAX };
+		constexpr static uint32_t MaxLeafObjects{ 4 };
+		constexpr static float RebuildCostRatio{ 1.5f }; // refit tree this much worse than a fresh one -> rebuild
+
+		struct Object
+		{
+			const Mesh* Source{};
+			Matrix4 Transform{};
+			Bounds LocalBounds{};
+			Bounds WorldBounds{};
+			uint32_t Leaf{ NoNode };
+			bool Alive{};
+			bool Moved{};
+		};
+
+		// inner nodes have Count == 0 and children First, First + 1; leaves own m_LeafObjects[First, First + Count)
+		struct Node
+		{
+			Bounds Box{};
+			uint32_t Parent{ NoNode };
+			uint32_t First{};
+			uint32_t Count{};
+		};
+
+		struct CachedBounds
+		{
+			unsigned Version{};
+			Bounds Box{};
+		};
+
+		std::vector<Object> m_Objects{};
+		std::vector<ObjectId> m_FreeIds{};
+		std::vector<ObjectId> m_MovedIds{};
+		std::vector<Node> m_Nodes{};
+		std::vector<ObjectId> m_LeafObjects{};
+		std::vector<std::pair<uint32_t, unsigned>> m_CullStack{}; // node, planes its parent wasn't fully inside of
+		std::unordered_map<const Mesh*, CachedBounds> m_MeshBounds{};
+		std::vector<ObjectId> m_Visible{};
+		bool m_NeedsRebuild{ false };
+		float m_BuildCost{};
+		SceneStats m_Stats{};
+
+	private:
+		void UpdateIndex();
+		void Rebuild();
+		void BuildNode(uint32_t node, size_t begin, size_t end);
+		void Refit();
+		float TreeCost() const;
+		void AddSubtree(uint32_t node, std::vector<ObjectId>& visible) const;
+	};
+}
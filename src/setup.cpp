@@ -0,0 +1,228 @@
+#include "setup.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TG_SETUP_AVX2
+#endif
+
+namespace TG
+{
+	constexpr int64_t Half{ SubCellOne / 2 };
+
+#ifdef TG_SETUP_AVX2
+	// lanes whose bit is set in mask, as an all-ones int32 per lane
+	static __m256i LaneMask(int mask)
+	{
+		const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), bits);
+	}
+
+	// a * b - c * d of int32 lanes, exactly: doubles hold the products of guard band coordinates.
+	// Bit l of the result is set if lane l came out negative; the values go to out, if given
+	static int MulSub(__m256i a, __m256i b, __m256i c, __m256i d, __m256d* out = nullptr)
+	{
+		int negative{ 0 };
+		for (int half = 0; half < 2; half++)
+		{
+			auto wide = [half](__m256i v)
+			{
+				return _mm256_cvtepi32_pd(half ? _mm256_extracti128_si256(v, 1) : _mm256_castsi256_si128(v));
+			};
+			const __m256d value = _mm256_sub_pd(_mm256_mul_pd(wide(a), wide(b)), _mm256_mul_pd(wide(c), wide(d)));
+			negative |= _mm256_movemask_pd(_mm256_cmp_pd(value, _mm256_setzero_pd(), _CMP_LT_OQ)) << (half * 4);
+			if (out)
+				out[half] = value;
+		}
+		return negative;
+	}
+
+	// integral doubles below 2^51 to int64: adding 1.5 * 2^52 puts the integer in the low mantissa bits
+	static __m256i ToInt64(__m256d value)
+	{
+		const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+		return _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(value, magic)), _mm256_castpd_si256(magic));
+	}
+
+	static void SetupBatch(const Vector3* const* verts, const int* corners, size_t count, FaceSetup& setup)
+	{
+		// AoS corners to SoA, lanes past count or without corners stay at zero: no area, so empty
+		alignas(32) float fx[4][SetupLanes]{};
+		alignas(32) float fy[4][SetupLanes]{};
+		for (size_t lane = 0; lane < count; lane++)
+		{
+			for (int i = 0; i < 4 && corners[lane] > 0; i++)
+			{
+				const Vector3& vert = verts[lane][i < corners[lane] ? i : 0];
+				fx[i][lane] = vert.x;
+				fy[i][lane] = vert.y;
+			}
+		}
+
+		// ToSubCell: scaled, half away from zero, truncated
+		const __m256 scale = _mm256_set1_ps(static_cast<float>(SubCellOne));
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		auto snap = [&](const float* values)
+		{
+			const __m256 v = _mm256_load_ps(values);
+			const __m256 rounding = _mm256_or_ps(_mm256_and_ps(v, sign), half);
+			return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), rounding));
+		};
+		__m256i x[4], y[4];
+		for (int i = 0; i < 4; i++)
+		{
+			x[i] = snap(fx[i]);
+			y[i] = snap(fy[i]);
+		}
+
+		int negative{ 0 };
+		__m256d area[2]{ _mm256_setzero_pd(), _mm256_setzero_pd() };
+		for (int i = 0; i < 4; i++)
+		{
+			__m256d term[2];
+			MulSub(x[i], y[(i + 1) % 4], x[(i + 1) % 4], y[i], term);
+			area[0] = _mm256_add_pd(area[0], term[0]);
+			area[1] = _mm256_add_pd(area[1], term[1]);
+		}
+		int zero{ 0 };
+		for (int h = 0; h < 2; h++)
+		{
+			negative |= _mm256_movemask_pd(_mm256_cmp_pd(area[h], _mm256_setzero_pd(), _CMP_LT_OQ)) << (h * 4);
+			zero |= _mm256_movemask_pd(_mm256_cmp_pd(area[h], _mm256_setzero_pd(), _CMP_EQ_OQ)) << (h * 4);
+		}
+		const __m256i flip = LaneMask(negative);
+		const __m256i x1 = x[1];
+		const __m256i y1 = y[1];
+		x[1] = _mm256_blendv_epi8(x[1], x[3], flip);
+		y[1] = _mm256_blendv_epi8(y[1], y[3], flip);
+		x[3] = _mm256_blendv_epi8(x[3], x1, flip);
+		y[3] = _mm256_blendv_epi8(y[3], y1, flip);
+
+		__m256i dx[4], dy[4];
+		for (int i = 0; i < 4; i++)
+		{
+			const int next = (i + 1) % 4;
+			dx[i] = _mm256_sub_epi32(x[next], x[i]);
+			dy[i] = _mm256_sub_epi32(y[next], y[i]);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.X[i]), x[i]);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.Y[i]), y[i]);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.Dx[i]), dx[i]);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.Dy[i]), dy[i]);
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			// the bias is -1 unless the edge is a top or left one, which is what the comparison masks are
+			const __m256i zeroes = _mm256_setzero_si256();
+			const __m256i topLeft = _mm256_or_si256(_mm256_cmpgt_epi32(zeroes, dy[i]),
+			                                        _mm256_and_si256(_mm256_cmpeq_epi32(dy[i], zeroes), _mm256_cmpgt_epi32(dx[i], zeroes)));
+			const __m256i bias = _mm256_xor_si256(topLeft, _mm256_set1_epi32(-1));
+			__m256d c[2];
+			MulSub(dy[i], x[i], dx[i], y[i], c);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.C[i]),
+			                    _mm256_add_epi64(ToInt64(c[0]), _mm256_cvtepi32_epi64(_mm256_castsi256_si128(bias))));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.C[i] + 4),
+			                    _mm256_add_epi64(ToInt64(c[1]), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(bias, 1))));
+		}
+
+		int reflex[4];
+		for (int i = 0; i < 4; i++)
+		{
+			const int prev = (i + 3) % 4;
+			reflex[i] = MulSub(dx[prev], dy[i], dy[prev], dx[i]);
+		}
+		for (size_t lane = 0; lane < SetupLanes; lane++)
+		{
+			setup.Split[lane] = -1;
+			for (int i = 3; i >= 0; i--)
+			{
+				if (reflex[i] & (1 << lane))
+					setup.Split[lane] = static_cast<int8_t>(i);
+			}
+		}
+
+		// CeilDiv(v - Half, One) = -((Half - v) >> bits), FloorDiv(v - Half, One) = (v - Half) >> bits
+		const __m256i halfCell = _mm256_set1_epi32(static_cast<int>(Half));
+		auto ceilRow = [halfCell](__m256i v)
+		{
+			return _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_srai_epi32(_mm256_sub_epi32(halfCell, v), SubCellBits));
+		};
+		auto floorRow = [halfCell](__m256i v) { return _mm256_srai_epi32(_mm256_sub_epi32(v, halfCell), SubCellBits); };
+		const __m256i top = ceilRow(_mm256_min_epi32(_mm256_min_epi32(y[0], y[1]), _mm256_min_epi32(y[2], y[3])));
+		const __m256i bottom = floorRow(_mm256_max_epi32(_mm256_max_epi32(y[0], y[1]), _mm256_max_epi32(y[2], y[3])));
+		const __m256i left = ceilRow(_mm256_min_epi32(_mm256_min_epi32(x[0], x[1]), _mm256_min_epi32(x[2], x[3])));
+		const __m256i right = floorRow(_mm256_max_epi32(_mm256_max_epi32(x[0], x[1]), _mm256_max_epi32(x[2], x[3])));
+		const __m256i empty = _mm256_or_si256(LaneMask(zero), _mm256_cmpgt_epi32(left, right));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.Top), top);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(setup.Bottom),
+		                    _mm256_blendv_epi8(bottom, _mm256_sub_epi32(top, _mm256_set1_epi32(1)), empty));
+	}
+#else
+	// one lane in int64, the same steps as the AVX2 pass
+	static void SetupLane(const Vector3* verts, int corners, FaceSetup& setup, size_t lane)
+	{
+		int64_t x[4]{};
+		int64_t y[4]{};
+		for (int i = 0; i < corners; i++)
+		{
+			x[i] = ToSubCell(verts[i].x);
+			y[i] = ToSubCell(verts[i].y);
+		}
+		if (corners == 3)
+		{
+			x[3] = x[0];
+			y[3] = y[0];
+		}
+
+		int64_t area{ 0 };
+		for (int i = 0; i < 4; i++)
+			area += x[i] * y[(i + 1) % 4] - x[(i + 1) % 4] * y[i];
+		if (area < 0) // reversing corners 1-3 of a triangle leaves its repeated corner second, still zero length
+		{
+			std::swap(x[1], x[3]);
+			std::swap(y[1], y[3]);
+		}
+
+		for (int i = 0; i < 4; i++)
+		{
+			const int next = (i + 1) % 4;
+			const int64_t dx = x[next] - x[i];
+			const int64_t dy = y[next] - y[i];
+			const bool topLeft = dy < 0 || (dy == 0 && dx > 0); // left edges go up, top edges go right
+			setup.X[i][lane] = static_cast<int32_t>(x[i]);
+			setup.Y[i][lane] = static_cast<int32_t>(y[i]);
+			setup.Dx[i][lane] = static_cast<int32_t>(dx);
+			setup.Dy[i][lane] = static_cast<int32_t>(dy);
+			setup.C[i][lane] = dy * x[i] - dx * y[i] + (topLeft ? 0 : -1);
+		}
+
+		setup.Split[lane] = -1;
+		for (int i = 3; i >= 0; i--)
+		{
+			const int prev = (i + 3) % 4;
+			if (int64_t{ setup.Dx[prev][lane] } * setup.Dy[i][lane] - int64_t{ setup.Dy[prev][lane] } * setup.Dx[i][lane] < 0)
+				setup.Split[lane] = static_cast<int8_t>(i);
+		}
+
+		const int64_t top = CeilDiv(*std::min_element(y, y + 4) - Half, SubCellOne);
+		const int64_t bottom = FloorDiv(*std::max_element(y, y + 4) - Half, SubCellOne);
+		const int64_t left = CeilDiv(*std::min_element(x, x + 4) - Half, SubCellOne);
+		const int64_t right = FloorDiv(*std::max_element(x, x + 4) - Half, SubCellOne);
+		const bool empty = area == 0 || left > right;
+		setup.Top[lane] = static_cast<int32_t>(top);
+		setup.Bottom[lane] = static_cast<int32_t>(empty ? top - 1 : bottom);
+	}
+#endif
+
+	void SetupFaces(const Vector3* const* verts, const int* corners, size_t count, FaceSetup& setup)
+	{
+#ifdef TG_SETUP_AVX2
+		SetupBatch(verts, corners, count, setup);
+#else
+		for (size_t lane = 0; lane < SetupLanes; lane++)
+			SetupLane(lane < count ? verts[lane] : nullptr, lane < count ? corners[lane] : 0, setup, lane);
+#endif
+	}
+}
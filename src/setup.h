@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "tgraphics.h"
+
+namespace TG
+{
+	constexpr size_t SetupLanes{ 8 };
+
+	// what DrawPolygon needs to know about eight projected faces, one lane each, worked out once per face instead of
+	// once per band it touches. Face f of a frame is lane f % SetupLanes of record f / SetupLanes
+	struct FaceSetup
+	{
+		// snapped corners, wound so the inside is where every edge function is >= 0. A triangle repeats its first
+		// corner, which makes one of its edges zero length
+		int32_t X[4][SetupLanes];
+		int32_t Y[4][SetupLanes];
+		// edge i runs from corner i to corner i + 1: E(px, py) = Dx * py - Dy * px + C, the top-left bias is in C
+		int32_t Dx[4][SetupLanes];
+		int32_t Dy[4][SetupLanes];
+		int64_t C[4][SetupLanes];
+		// rows whose centers are in the face's y range, not clamped to the screen. Top > Bottom if there's nothing
+		// to draw: no area, or no cell center in its bounds
+		int32_t Top[SetupLanes];
+		int32_t Bottom[SetupLanes];
+		int8_t Split[SetupLanes]; // a quad corner snapping bent inwards, -1 if none; DrawPolygon splits the quad there
+	};
+
+	// Sets up lanes [0, count) of setup, count <= SetupLanes; corners[i] is 3 or 4, or 0 for a lane left empty.
+	// With AVX2 all eight lanes go through at once: the products are exact in doubles, coordinates stay within the
+	// guard band
+	void SetupFaces(const Vector3* const* verts, const int* corners, size_t count, FaceSetup& setup);
+}
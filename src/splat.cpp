@@ -0,0 +1,130 @@
+#include "splat.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TG_SPLAT_SSE2
+#endif
+
+namespace TG
+{
+	uint32_t ClassifyFace(const Vector3* verts, int corners, int width, int height, SplatBatch& batch, uint32_t at)
+	{
+		constexpr int64_t One{ SubCellOne };
+		constexpr int64_t Half{ One / 2 };
+		int64_t x[4], y[4];
+		for (int i = 0; i < corners; i++)
+		{
+			x[i] = ToSubCell(verts[i].x);
+			y[i] = ToSubCell(verts[i].y);
+		}
+
+		// cell centers inside the bounds. Counted before clamping to the screen: a face reaching off screen isn't small
+		const int64_t firstRow = CeilDiv(*std::min_element(y, y + corners) - Half, One);
+		const int64_t lastRow = FloorDiv(*std::max_element(y, y + corners) - Half, One);
+		const int64_t firstColumn = CeilDiv(*std::min_element(x, x + corners) - Half, One);
+		const int64_t lastColumn = FloorDiv(*std::max_element(x, x + corners) - Half, One);
+		if (std::max<int64_t>(firstRow, 0) > std::min<int64_t>(lastRow, height - 1) ||
+		    std::max<int64_t>(firstColumn, 0) > std::min<int64_t>(lastColumn, width - 1))
+			return NoCell;
+		if (firstRow != lastRow || firstColumn != lastColumn)
+			return RasterFace;
+
+		int64_t area{ 0 };
+		for (int i = 0; i < corners; i++)
+		{
+			const int next = (i + 1) % corners;
+			area += x[i] * y[next] - x[next] * y[i];
+		}
+		if (area == 0)
+			return NoCell;
+		if (area < 0)
+		{
+			std::reverse(x + 1, x + corners);
+			std::reverse(y + 1, y + corners);
+		}
+		// a quad corner bent inwards by snapping gets split by DrawPolygon, the edges alone don't describe it
+		for (int i = 0; i < corners && corners == 4; i++)
+		{
+			const int prev = (i + 3) % 4;
+			const int next = (i + 1) % 4;
+			if ((x[i] - x[prev]) * (y[next] - y[i]) - (y[i] - y[prev]) * (x[next] - x[i]) < 0)
+				return RasterFace;
+		}
+
+		const int64_t centerX{ firstColumn * One + Half };
+		const int64_t centerY{ firstRow * One + Half };
+		const size_t lane{ batch.Count++ };
+		for (int i = 0; i < 4; i++)
+		{
+			const int corner = i < corners ? i : 0;
+			batch.X[i][lane] = static_cast<float>(x[corner] - centerX);
+			batch.Y[i][lane] = static_cast<float>(y[corner] - centerY);
+		}
+		batch.Cell[lane] = static_cast<uint32_t>(firstRow * width + firstColumn);
+		batch.At[lane] = at;
+		return SplatPending;
+	}
+
+	// E = dx * (py - y) - dy * (px - x) at the center (0, 0) has to be >= 0 for every edge, > 0 unless the edge is
+	// a top or left one. Edges of corners snapped together don't count
+	static bool CoversCenter(const SplatBatch& batch, size_t lane)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			const int next = (i + 1) % 4;
+			const float dx = batch.X[next][lane] - batch.X[i][lane];
+			const float dy = batch.Y[next][lane] - batch.Y[i][lane];
+			if (dx == 0.0f && dy == 0.0f)
+				continue;
+			const float e = dy * batch.X[i][lane] - dx * batch.Y[i][lane];
+			const bool topLeft = dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+			if (e < 0.0f || (e == 0.0f && !topLeft))
+				return false;
+		}
+		return true;
+	}
+
+	size_t TestSplats(SplatBatch& batch, uint32_t* cells)
+	{
+		size_t misses{ 0 };
+#ifdef TG_SPLAT_SSE2
+		if (batch.Count == 4)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int i = 0; i < 4; i++)
+			{
+				const int next = (i + 1) % 4;
+				const __m128 x = _mm_loadu_ps(batch.X[i]);
+				const __m128 y = _mm_loadu_ps(batch.Y[i]);
+				const __m128 dx = _mm_sub_ps(_mm_loadu_ps(batch.X[next]), x);
+				const __m128 dy = _mm_sub_ps(_mm_loadu_ps(batch.Y[next]), y);
+				const __m128 e = _mm_sub_ps(_mm_mul_ps(dy, x), _mm_mul_ps(dx, y));
+				const __m128 topLeft = _mm_or_ps(_mm_cmplt_ps(dy, zero), _mm_and_ps(_mm_cmpeq_ps(dy, zero), _mm_cmpgt_ps(dx, zero)));
+				const __m128 empty = _mm_and_ps(_mm_cmpeq_ps(dx, zero), _mm_cmpeq_ps(dy, zero));
+				const __m128 pass = _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_or_ps(_mm_and_ps(_mm_cmpeq_ps(e, zero), topLeft), empty));
+				inside = _mm_and_ps(inside, pass);
+			}
+			const int mask = _mm_movemask_ps(inside);
+			for (size_t lane = 0; lane < 4; lane++)
+			{
+				const bool covered = (mask >> lane) & 1;
+				cells[batch.At[lane]] = covered ? batch.Cell[lane] : NoCell;
+				misses += !covered;
+			}
+			batch.Count = 0;
+			return misses;
+		}
+#endif
+		for (size_t lane = 0; lane < batch.Count; lane++)
+		{
+			const bool covered = CoversCenter(batch, lane);
+			cells[batch.At[lane]] = covered ? batch.Cell[lane] : NoCell;
+			misses += !covered;
+		}
+		batch.Count = 0;
+		return misses;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "tgraphics.h"
+
+namespace TG
+{
+	// what the vertex stage tells the rasterizer about a projected face, besides a splat's cell (row * width + column)
+	constexpr uint32_t RasterFace{ UINT32_MAX }; // more than one cell center in its bounds: Graphics::DrawPolygon
+	constexpr uint32_t NoCell{ UINT32_MAX - 1 }; // covers no cell center, nothing to draw
+	constexpr uint32_t SplatPending{ UINT32_MAX - 2 }; // waiting in a SplatBatch
+
+	// up to four faces that may cover the one cell center inside their bounds, relative to that center in fixed point.
+	// Corners are wound the way DrawPolygon winds them; a triangle repeats its first corner
+	struct SplatBatch
+	{
+		float X[4][4]{}; // [corner][face]
+		float Y[4][4]{};
+		uint32_t Cell[4]{};
+		uint32_t At[4]{}; // the caller's index of each face
+		size_t Count{};
+	};
+
+	// Sorts a projected face by its snapped bounds: NoCell if they hold no cell center on screen, RasterFace if
+	// more than one. A face with exactly one joins batch as at and gets SplatPending; flush the batch once it's full
+	uint32_t ClassifyFace(const Vector3* verts, int corners, int width, int height, SplatBatch& batch, uint32_t at);
+
+	// Tests the batch's faces against their cell centers, with DrawPolygon's top-left rule: cells[At] becomes the cell,
+	// or NoCell if the center is outside. The four faces go through at a time in SSE registers, one lane each.
+	// Coordinates are within a cell of the center, so the edge functions are exact in floats. Empties the batch,
+	// returns how many of its faces missed
+	size_t TestSplats(SplatBatch& batch, uint32_t* cells);
+}
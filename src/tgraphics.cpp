@@ -1,12 +1,75 @@
 #include "tgraphics.h"
+#include "commandbuffer.h"
+#include "instancing.h"
+#include "setup.h"
+#include "splat.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <string>
+#include <type_traits>
 
 namespace TG
 {
 	constexpr float PI = 3.141592f;
+	// cells past each screen edge that are left to the rasterizer's scissor instead of being clipped.
+	// Small enough that coordinates stay exact in floats and fit in a short
+	constexpr float GuardBandCells = 4096.0f;
+	constexpr size_t MaxClipVertices = 4 + 5; // a quad's corners, each of the 5 clip planes adds at most one
+	constexpr size_t MaxClipTriangles = MaxClipVertices - 2;
+
+	// the glyph of a face lit at this angle: the dot product of its normal and the light
+	static Glyph LightGlyph(float dp)
+	{
+		if(dp > 0.75f)
+		{
+			return GlyphFull;
+		}else if (dp > 0.5f)
+		{
+			return GlyphDark;
+		}else if (dp > 0.25f)
+		{
+			return GlyphMedium;
+		}else if(dp > 0.0f)
+		{
+			return GlyphLight;
+		}
+
+		return ' ';
+	}
+
+	// RasterMode::Smooth: a shade, the light quantized to 0-255, to its glyph. Same levels as the flat faces
+	static const auto ShadeGlyphs = []
+	{
+		std::array<Glyph, 256> glyphs{};
+		for (size_t i = 0; i < glyphs.size(); i++)
+			glyphs[i] = LightGlyph(static_cast<float>(i) / 255.0f);
+		return glyphs;
+	}();
+
+	// the light falling on a face with this view space normal and center, the sum of all lights
+	static float FaceLight(const LightSet& lights, const Vector3& normal, const Vector3& center)
+	{
+		float light{ 0.0f };
+		for (size_t i = 0; i < lights.Count; i++)
+		{
+			const Light& source = lights.Items[i];
+			if (source.Type == LightType::Directional)
+			{
+				light += source.Intensity * std::max(DotProduct(normal, source.Direction), 0.0f);
+				continue;
+			}
+			const Vector3 toLight{ source.Position.x - center.x, source.Position.y - center.y, source.Position.z - center.z };
+			const float dp{ DotProduct(normal, toLight) };
+			if (dp > 0.0f)
+				light += source.Intensity * dp / toLight.Length();
+		}
+		return light;
+	}
 
 	Vector3 operator*(const Matrix4& mat, const Vector3& vec)
 	{
@@ -27,6 +90,16 @@ namespace TG
 
 	Vector3 operator*(const Vector3& vec, const Matrix4& mat) { return mat * vec; }
 
+	Matrix4 operator*(const Matrix4& a, const Matrix4& b)
+	{
+		Matrix4 result{};
+		for (int row = 0; row < 4; row++)
+			for (int col = 0; col < 4; col++)
+				for (int i = 0; i < 4; i++)
+					result.m[row][col] += a.m[row][i] * b.m[i][col];
+		return result;
+	}
+
 	//const Vector3& MatVecM(const Vector3& vec, const Matrix4& mat)
 	//{
 	//	float x = vec.x * mat.m[0][0] + vec.y * mat.m[1][0] + vec.z * mat.m[2][0] + mat.m[3][0];
@@ -42,6 +115,128 @@ namespace TG
 	//	}
 	//}
 
+	void Bounds::Expand(const Bounds& other)
+	{
+		Min = Vector3{ std::min(Min.x, other.Min.x), std::min(Min.y, other.Min.y), std::min(Min.z, other.Min.z) };
+		Max = Vector3{ std::max(Max.x, other.Max.x), std::max(Max.y, other.Max.y), std::max(Max.z, other.Max.z) };
+	}
+
+	float Bounds::SurfaceArea() const
+	{
+		const float dx = Max.x - Min.x;
+		const float dy = Max.y - Min.y;
+		const float dz = Max.z - Min.z;
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	}
+
+	bool Bounds::operator==(const Bounds& other) const
+	{
+		return Min.x == other.Min.x && Min.y == other.Min.y && Min.z == other.Min.z &&
+			Max.x == other.Max.x && Max.y == other.Max.y && Max.z == other.Max.z;
+	}
+
+	Bounds BoundsOf(const Mesh& mesh)
+	{
+		Bounds box{};
+		bool empty{ true };
+		auto expand = [&box, &empty](const auto& face)
+		{
+			for (const Vector3& vert : face.verts)
+			{
+				box = empty ? Bounds{ vert, vert } : box;
+				box.Expand(Bounds{ vert, vert });
+				empty = false;
+			}
+		};
+		for (const Triangle& tri : mesh.Tris)
+			expand(tri);
+		for (const Quad& quad : mesh.Quads)
+			expand(quad);
+		return box;
+	}
+
+	Bounds TransformBounds(const Bounds& local, const Matrix4& transform)
+	{
+		const float center[3]{ (local.Min.x + local.Max.x) * 0.5f, (local.Min.y + local.Max.y) * 0.5f, (local.Min.z + local.Max.z) * 0.5f };
+		const float extent[3]{ (local.Max.x - local.Min.x) * 0.5f, (local.Max.y - local.Min.y) * 0.5f, (local.Max.z - local.Min.z) * 0.5f };
+
+		float worldCenter[3]{};
+		float worldExtent[3]{};
+		for (int col = 0; col < 3; col++)
+		{
+			worldCenter[col] = transform.m[3][col];
+			for (int row = 0; row < 3; row++)
+			{
+				worldCenter[col] += center[row] * transform.m[row][col];
+				worldExtent[col] += extent[row] * std::fabs(transform.m[row][col]);
+			}
+		}
+		return Bounds{
+			{ worldCenter[0] - worldExtent[0], worldCenter[1] - worldExtent[1], worldCenter[2] - worldExtent[2] },
+			{ worldCenter[0] + worldExtent[0], worldCenter[1] + worldExtent[1], worldCenter[2] + worldExtent[2] }
+		};
+	}
+
+	Frustum Frustum::FromCamera(const Camera& camera, short screenWidth, short screenHeight)
+	{
+		// same projection as the vertex stage: ndc x = aspect * fov * x / z lands on screen for [-0.6, 1.4]
+		// (the renderer's centering offset), ndc y = fov * y / z for [-1, 1]. View z is world z + ZOffset
+		const float fovRad{ 1.0f / tanf(camera.Fov * 0.5f / 180.0f * PI) };
+		const float xScale{ static_cast<float>(screenHeight) / static_cast<float>(screenWidth) * fovRad };
+		const float z{ camera.ZOffset };
+
+		Frustum frustum{};
+		frustum.Planes[0] = Plane{ { xScale, 0, 0.6f }, 0.6f * z };
+		frustum.Planes[1] = Plane{ { -xScale, 0, 1.4f }, 1.4f * z };
+		frustum.Planes[2] = Plane{ { 0, fovRad, 1.0f }, z };
+		frustum.Planes[3] = Plane{ { 0, -fovRad, 1.0f }, z };
+		frustum.Planes[4] = Plane{ { 0, 0, 1.0f }, z - camera.ZNear };
+		frustum.Planes[5] = Plane{ { 0, 0, -1.0f }, camera.ZFar - z };
+		return frustum;
+	}
+
+	bool IsFlatConvex(const Quad& quad)
+	{
+		constexpr float FlatTolerance{ 1e-4f }; // off the plane, relative to the quad's size
+
+		// Newell's normal: the quad's area vector even if it's bent
+		Vector3 normal{};
+		Vector3 center{};
+		float size{ 0.0f };
+		for (int i = 0; i < 4; i++)
+		{
+			const Vector3& a = quad.verts[i];
+			const Vector3& b = quad.verts[(i + 1) % 4];
+			normal.x += (a.y - b.y) * (a.z + b.z);
+			normal.y += (a.z - b.z) * (a.x + b.x);
+			normal.z += (a.x - b.x) * (a.y + b.y);
+			center = Vector3{ center.x + a.x * 0.25f, center.y + a.y * 0.25f, center.z + a.z * 0.25f };
+			size = std::max(size, Vector3{ b.x - a.x, b.y - a.y, b.z - a.z }.Length());
+		}
+		const float length = normal.Length();
+		if (length <= 0.0f || size <= 0.0f)
+			return false;
+		normal = Vector3{ normal.x / length, normal.y / length, normal.z / length };
+
+		for (int i = 0; i < 4; i++)
+		{
+			const Vector3& prev = quad.verts[(i + 3) % 4];
+			const Vector3& corner = quad.verts[i];
+			const Vector3& next = quad.verts[(i + 1) % 4];
+			const Vector3 offset{ corner.x - center.x, corner.y - center.y, corner.z - center.z };
+			if (fabsf(DotProduct(normal, offset)) > FlatTolerance * size)
+				return false;
+
+			// every corner turns the same way as the whole quad, and not straight on (those are triangles really)
+			const Vector3 a{ corner.x - prev.x, corner.y - prev.y, corner.z - prev.z };
+			const Vector3 b{ next.x - corner.x, next.y - corner.y, next.z - corner.z };
+			const Vector3 turn{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+			if (DotProduct(normal, turn) <= FlatTolerance * size * size)
+				return false;
+		}
+		return true;
+	}
+
 	const Vector3& CrossProduct(const Vector3& a, const Vector3& b)
 	{
 		return {
@@ -64,281 +259,1880 @@ namespace TG
 
 	void Graphics::Clear()
 	{
-		clear();
+		m_Frame.Clear();
+		m_Covered.assign(static_cast<size_t>(m_Frame.Width()) * m_Frame.Height(), 0);
 		//std::wcout << L"\x1b[1;1H\x1b[2J";
 	}
 
-	void Graphics::Draw(float elapsedTime)
+	void Graphics::Update(float step)
 	{
-		static float zOffset = 20.0f;
-		static float rotAngle{ 0.0f };
-		rotAngle += 1.0f * elapsedTime;
-		static const float fov{ 80.0f };
-		static const float fovRad{ 1.0f / tanf( fov * 0.5f / 180.0f * PI ) };
-		static const float aspectRatio{ static_cast<float>(m_ScreenHeight) / static_cast<float>(m_ScreenWidth) };
-		static const float zNear{ 0.1f };
-		static const float zFar{ 1000.0f };
+		m_PrevRotAngle = m_RotAngle;
+		if (!Paused)
+			m_RotAngle += 1.0f * step;
+	}
 
-		constexpr static Vector3 lightDirection{0, 0, -1};
+	static bool SameLights(const LightSet& a, const LightSet& b)
+	{
+		auto same = [](const Vector3& u, const Vector3& v) { return u.x == v.x && u.y == v.y && u.z == v.z; };
+		if (a.Count != b.Count)
+			return false;
+		for (size_t i = 0; i < a.Count; i++)
+		{
+			const Light& u = a.Items[i];
+			const Light& v = b.Items[i];
+			if (u.Type != v.Type || u.Intensity != v.Intensity || !same(u.Direction, v.Direction) || !same(u.Position, v.Position))
+				return false;
+		}
+		return true;
+	}
 
-		// rotation matrix for 3d space - https://w.wiki/AjaZ
-		Matrix4 rotXMat{
-			{
-				{1, 0, 0, 0},
-				{0, cosf(rotAngle * 0.5f), -sinf(rotAngle * 0.5f), 0},
-				{0, sinf(rotAngle * 0.5f), cosf(rotAngle * 0.5f), 0},
-				{0, 0, 0, 1}
-			}
-		};
+	static bool SameMatrix(const Matrix4& a, const Matrix4& b)
+	{
+		return std::equal(&a.m[0][0], &a.m[0][0] + 16, &b.m[0][0]);
+	}
 
-		Matrix4 rotZMat{
-			{
-				{cosf(rotAngle), -sinf(rotAngle), 0, 0},
-				{sinf(rotAngle), cosf(rotAngle), 0, 0},
-				{0, 0, 1, 0},
-				{0, 0, 0, 1},
-			}
-		};
+	LightSet Graphics::SceneLights() const
+	{
+		if (Lights.size() > MaxLights)
+			throw std::exception("More lights than MaxLights");
+		LightSet lights{};
+		std::copy(Lights.begin(), Lights.end(), lights.Items);
+		lights.Count = Lights.size();
+		return lights;
+	}
 
-		static Matrix4 projMatrix{
-			{
-				{ aspectRatio * fovRad, 0, 0, 0 },
-				{	0, fovRad, 0, 0 },
-				{ 0, 0, zFar / (zFar - zNear),  1 },
-				{ 0, 0, (-zFar * zNear) / (zFar - zNear),0 },
-			}
-		};
+	static bool SameScene(const SceneState& a, const SceneState& b)
+	{
+		return a.RotAngle == b.RotAngle &&
+			a.View.ZOffset == b.View.ZOffset && a.View.Fov == b.View.Fov &&
+			a.View.ZNear == b.View.ZNear && a.View.ZFar == b.View.ZFar &&
+			SameLights(a.Lights, b.Lights) &&
+			a.MeshVersion == b.MeshVersion && a.Raster == b.Raster && a.PerspectiveStep == b.PerspectiveStep &&
+			a.ScreenWidth == b.ScreenWidth && a.ScreenHeight == b.ScreenHeight;
+	}
 
-		SetCursorPosition(COORD{ 0,0 });
-		printw("%f", elapsedTime);
-
-		std::vector<Triangle> triToRaster{};
-
-		for(auto tri : Model.Tris) // draw Model mesh
-		{
-			Vector3 rotatedZ[3];
-			//rotatedZ[0] = MatVecM(tri.verts[0], rotZMat);
-			//rotatedZ[1] = MatVecM(tri.verts[1], rotZMat);
-			//rotatedZ[2] = MatVecM(tri.verts[2], rotZMat);
-			rotatedZ[0] = tri.verts[0] * rotZMat;
-			rotatedZ[1] = tri.verts[1] * rotZMat;
-			rotatedZ[2] = tri.verts[2] * rotZMat;
-
-			Vector3 rotatedXZ[3];
-			//rotatedXZ[0] = MatVecM(rotatedZ[0], rotXMat);
-			//rotatedXZ[1] = MatVecM(rotatedZ[1], rotXMat);
-			//rotatedXZ[2] = MatVecM(rotatedZ[2], rotXMat);
-			rotatedXZ[0] = rotatedZ[0] * rotXMat;
-			rotatedXZ[1] = rotatedZ[1] * rotXMat;
-			rotatedXZ[2] = rotatedZ[2] * rotXMat;
-			
-			rotatedXZ[0].z += zOffset;
-			rotatedXZ[1].z += zOffset;
-			rotatedXZ[2].z += zOffset;
-
-			Vector3 a, b; // make lines for cross product
-			a.x = rotatedXZ[1].x - rotatedXZ[0].x;
-			a.y = rotatedXZ[1].y - rotatedXZ[0].y;
-			a.z = rotatedXZ[1].z - rotatedXZ[0].z;
-			b.x = rotatedXZ[2].x - rotatedXZ[0].x;
-			b.y = rotatedXZ[2].y - rotatedXZ[0].y;
-			b.z = rotatedXZ[2].z - rotatedXZ[0].z;
-
-			Vector3 cp = CrossProduct(a, b);
-			Vector3 normCp = cp.Normalize();
+	void Graphics::Draw(const FrameTiming& timing)
+	{
+		// everything allocated since the last Draw call, presenting included
+		const unsigned long long allocations = HeapAllocationCount();
+		m_FrameAllocations = allocations - m_LastAllocationCount;
+		m_LastAllocationCount = allocations;
+		m_LastTiming = timing;
 
-			if(DotProduct(normCp, rotatedXZ[0]) > 0.0f) // see if less than 90 degrees
+		// render between the last two simulation steps, so motion stays smooth at any frame rate
+		const SceneState scene{
+			m_PrevRotAngle + (m_RotAngle - m_PrevRotAngle) * timing.Alpha,
+			View, SceneLights(), Model.Version, m_ScreenWidth, m_ScreenHeight, FrontToBack, Raster, PerspectiveStep
+		};
+
+		if (m_SceneValid && SameScene(scene, m_LastScene))
+		{
+			if (m_PendingCount > 0)
 			{
-				continue;
+				RetireFrame(); // nothing new to start, drain the pipeline instead
+				return;
 			}
+			m_SkippedFrames++; // the framebuffer still holds this exact image
+			// a slow terminal still has frames queued: keep them draining, the newest one last, instead of encoding
+			// the same image once more
+			if (m_Presenter.Stats().QueuedBytes > 0)
+				m_Presenter.Poll();
+			else
+				PresentFrame(timing);
+			return;
+		}
 
-			Vector3 proj[3];
-			//proj[0] = MatVecM(rotatedXZ[0], projMatrix);
-			//proj[1] = MatVecM(rotatedXZ[1], projMatrix);
-			//proj[2] = MatVecM(rotatedXZ[2], projMatrix);
-			proj[0] = rotatedXZ[0] * projMatrix;
-			proj[1] = rotatedXZ[1] * projMatrix;
-			proj[2] = rotatedXZ[2] * projMatrix;
-
-			proj[0].x = (proj[0].x + 0.6f) * (0.5f * m_ScreenWidth);
-			proj[0].y = (proj[0].y + 1.0f) * (0.5f * m_ScreenHeight);
-			proj[1].x = (proj[1].x + 0.6f) * (0.5f * m_ScreenWidth);
-			proj[1].y = (proj[1].y + 1.0f) * (0.5f * m_ScreenHeight);
-			proj[2].x = (proj[2].x + 0.6f) * (0.5f * m_ScreenWidth);
-			proj[2].y = (proj[2].y + 1.0f) * (0.5f * m_ScreenHeight);
-
-			Triangle toRaster{
-				{
-					{proj[0].x, proj[0].y, proj[0].z},
-					{proj[1].x, proj[1].y, proj[1].z},
-					{proj[2].x, proj[2].y, proj[2].z},
-				}
-			};
+		SubmitGeometry(scene, m_Slots[(m_PendingFirst + m_PendingCount) % MaxPipelineDepth]);
+		m_PendingCount++;
+		m_LastScene = scene;
+		m_SceneValid = true;
 
-			toRaster.filler = PixelIllumination(lightDirection, normCp);
+		if (m_PendingCount >= m_PipelineDepth)
+			RetireFrame();
+		else
+			PresentFrame(timing); // pipeline is still filling up, show the last image again
+	}
 
-			triToRaster.push_back(toRaster);
-		}
+	void Graphics::SetPipelineDepth(unsigned depth)
+	{
+		Flush();
+		m_PipelineDepth = std::clamp(depth, 1u, MaxPipelineDepth);
+	}
 
-		std::sort(triToRaster.begin(), triToRaster.end(), [](Triangle& t1, Triangle& t2)
+	void Graphics::Flush()
+	{
+		while (m_PendingCount > 0)
 		{
-				float z1 = (t1.verts[0].z + t1.verts[1].z + t1.verts[2].z) / 3.0f;
-				float z2 = (t2.verts[0].z + t2.verts[1].z + t2.verts[2].z) / 3.0f;
-				return z1 > z2;
-		});
+			RetireFrame();
+		}
+	}
 
-		for(auto tri : triToRaster)
+	void Graphics::DiscardPending()
+	{
+		// the jobs still point at the slots and the mesh, let them finish before any of it goes away
+		for (; m_PendingCount > 0; m_PendingCount--)
 		{
-			DrawTriangle(tri);
+			m_Jobs.Wait(m_Slots[m_PendingFirst].Geometry);
+			m_PendingFirst = (m_PendingFirst + 1) % MaxPipelineDepth;
 		}
+	}
 
-		refresh();
-		Clear();
+	void Graphics::RetireFrame()
+	{
+		FrameSlot& slot = m_Slots[m_PendingFirst];
+		m_Jobs.Wait(slot.Geometry);
+		RasterSlot(slot);
+		m_SortStats = slot.Sort;
+		m_PendingFirst = (m_PendingFirst + 1) % MaxPipelineDepth;
+		m_PendingCount--;
+
+		PresentFrame(m_LastTiming);
+		m_PresentLatency = std::chrono::duration<float>(std::chrono::steady_clock::now() - slot.Submitted).count();
 	}
 
-	void Graphics::DrawLine(COORD startPoint, COORD endPoint, const char fillChar[]) // Bresenham's line algorithm
+	void Graphics::PresentFrame(const FrameTiming& timing)
 	{
-		enum class YDirection { UP, DOWN } ydir{YDirection::UP};
-		enum class XDirection{ RIGHT, LEFT } xdir{XDirection::RIGHT};
+		// overlay only goes on top for presenting, the scene image stays intact for skipped frames
+		m_OverlayBackup.assign(m_Frame.Row(0), m_Frame.Row(0) + m_Frame.Width());
+		m_OverlayColorsBackup.assign(m_Frame.ColorRow(0), m_Frame.ColorRow(0) + m_Frame.Width());
 
-		bool invert {false};
-		float error{0.0f};
-		short dx = endPoint.X - startPoint.X;
-		if (dx < 0) {
-			dx = -dx;
-			xdir = XDirection::LEFT;
-		}
-		short dy = endPoint.Y - startPoint.Y;
-		if (dy < 0) {
-			dy = -dy;
-			ydir = YDirection::DOWN;
-		}
-		// dx > dy => line's up => one pixel per column
-		// dx < dy => line's down => one pixel per row
-		if (dx < dy)
-			invert = true;
-		const float m = static_cast<float>(dy) / static_cast<float>(dx); // slope.  how much change in Y, for 1 change in X
+		const PresentStats& stats = m_Presenter.Stats();
+		const SortStats& sort = m_SortStats;
+		char overlay[256]{};
+		snprintf(overlay, sizeof(overlay),
+		         "frame: %.2fms busy: %.2fms cpu: %3.0f%% dropped: %llu queued: %zu skipped: %llu allocs: %llu "
+		         "sort: %.3fms %zu/%zu kept, %zu moves%s overdraw: %.2fx latency: %.2fms (%u deep)%s",
+		         timing.FrameTime * 1000.0f, timing.BusyTime * 1000.0f, timing.CpuUtilization * 100.0f,
+		         stats.DroppedFrames, stats.QueuedBytes, m_SkippedFrames, m_FrameAllocations,
+		         sort.Time * 1000.0f, sort.Reused, sort.Keys, sort.Moves, sort.FullSort ? " (full)" : "", m_RasterStats.Overdraw(),
+		         m_PresentLatency * 1000.0f, m_PipelineDepth, Paused ? " [paused]" : "");
+		m_Frame.Text(0, 0, overlay);
 
-		if (dx <= dy) { // invert
-			const float m = static_cast<float>(dx) / static_cast<float>(dy); // slope.  how much change in Y, for 1 change in X
-			while (startPoint.Y != endPoint.Y)
-			{
-				SetCursorPosition(startPoint);
-				printw("%s", fillChar);
+		m_Presenter.Present(m_Frame);
+		m_Frame.SetRow(0, m_OverlayBackup.data(), m_OverlayColorsBackup.data());
+	}
 
-				if (ydir == YDirection::UP)
-					startPoint.Y++; // move Y down
-				else
-					startPoint.Y--; // move X up
-				error += std::abs(m);
-				if (error > 0.5f && error < 500.0f)
+	// view space position to screen cells; z becomes the projected depth the sort uses
+	static Vector3 ProjectView(const VertexStageSetup& setup, const Vector3& view)
+	{
+		Vector3 proj = view * setup.Proj;
+		proj.x = (proj.x + 0.6f) * (0.5f * setup.ScreenWidth);
+		proj.y = (proj.y + 1.0f) * (0.5f * setup.ScreenHeight);
+		return proj;
+	}
+
+	static bool InsideGuardBand(const VertexStageSetup& setup, const Vector3& proj)
+	{
+		return proj.x >= -GuardBandCells && proj.x <= setup.ScreenWidth + GuardBandCells &&
+			proj.y >= -GuardBandCells && proj.y <= setup.ScreenHeight + GuardBandCells;
+	}
+
+	// all vertices past the same screen edge. Cells are truncated coordinates, so (-1, 0) is still column 0
+	template <size_t Corners>
+	static bool OffScreen(const VertexStageSetup& setup, const Vector3 (&proj)[Corners])
+	{
+		auto all = [&proj](auto outside) { return std::all_of(proj, proj + Corners, outside); };
+		return all([](const Vector3& p) { return p.x <= -1.0f; }) ||
+			all([&setup](const Vector3& p) { return p.x >= setup.ScreenWidth; }) ||
+			all([](const Vector3& p) { return p.y <= -1.0f; }) ||
+			all([&setup](const Vector3& p) { return p.y >= setup.ScreenHeight; });
+	}
+
+	// Sutherland-Hodgman in view space against the near plane and the guard band, then projects the polygon
+	// that's left and fans it into out. Returns the number of triangles, at most MaxClipTriangles
+	static size_t ClipPolygon(const VertexStageSetup& setup, const Vector3* view, const uint8_t* shade, size_t corners,
+	                          Glyph filler, Triangle* out)
+	{
+		// planes are a.x + b.y + c.z + d >= 0. The guard band ones are screen x = (x * Proj[0][0] / z + 0.6) * w/2
+		// kept inside [-GuardBand, w + GuardBand], multiplied by z, which the near plane made positive
+		const float scaleX{ setup.Proj.m[0][0] };
+		const float scaleY{ setup.Proj.m[1][1] };
+		const float left{ -GuardBandCells * 2.0f / setup.ScreenWidth - 0.6f };
+		const float right{ (setup.ScreenWidth + GuardBandCells) * 2.0f / setup.ScreenWidth - 0.6f };
+		const float top{ -GuardBandCells * 2.0f / setup.ScreenHeight - 1.0f };
+		const float bottom{ (setup.ScreenHeight + GuardBandCells) * 2.0f / setup.ScreenHeight - 1.0f };
+		const float planes[5][4]{
+			{ 0.0f, 0.0f, 1.0f, -setup.ZNear },
+			{ scaleX, 0.0f, -left, 0.0f },
+			{ -scaleX, 0.0f, right, 0.0f },
+			{ 0.0f, scaleY, -top, 0.0f },
+			{ 0.0f, -scaleY, bottom, 0.0f },
+		};
+
+		Vector3 polygon[MaxClipVertices]{};
+		float shades[MaxClipVertices]{}; // new corners get theirs interpolated along the edge, like the position
+		std::copy(view, view + corners, polygon);
+		std::copy(shade, shade + corners, shades);
+		size_t count{ corners };
+		for (const auto& plane : planes)
+		{
+			auto distance = [&plane](const Vector3& v) { return plane[0] * v.x + plane[1] * v.y + plane[2] * v.z + plane[3]; };
+			Vector3 clipped[MaxClipVertices];
+			float clippedShades[MaxClipVertices];
+			size_t kept{ 0 };
+			for (size_t i = 0; i < count; i++)
+			{
+				const size_t next{ (i + 1) % count };
+				const Vector3& a = polygon[i];
+				const Vector3& b = polygon[next];
+				const float da{ distance(a) };
+				const float db{ distance(b) };
+				if (da >= 0.0f)
 				{
-					if (xdir == XDirection::RIGHT)
-						startPoint.X++; // move X right
-					else
-						startPoint.X--; // move X left
-					error -= 1.0f;
+					clippedShades[kept] = shades[i];
+					clipped[kept++] = a;
 				}
-			}
-		}
-		else { // not invert
-			while (startPoint.X != endPoint.X)
-			{
-				SetCursorPosition(startPoint);
-				printw("%s", fillChar);
-
-				if (xdir == XDirection::RIGHT)
-					startPoint.X++; // move X right
-				else
-					startPoint.X--; // move X left
-				error += std::abs(m);
-				if (error > 0.5f && error < 500.0f)
+				if ((da >= 0.0f) != (db >= 0.0f))
 				{
-					if (ydir == YDirection::UP)
-						startPoint.Y++; // move Y down
-					else
-						startPoint.Y--; // move Y up
-					error -= 1.0f;
+					const float t{ da / (da - db) };
+					clippedShades[kept] = shades[i] + (shades[next] - shades[i]) * t;
+					clipped[kept++] = Vector3{ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t };
 				}
 			}
+			if (kept < 3)
+				return 0;
+			std::copy(clipped, clipped + kept, polygon);
+			std::copy(clippedShades, clippedShades + kept, shades);
+			count = kept;
 		}
-	}
 
-	const Vector3& interpolate(const Point2& p1, const Point2& p2, float factor) {
-		return Vector3{(p1.x + (p2.x - p1.x) * factor )};
+		for (size_t i = 0; i < count; i++)
+		{
+			polygon[i] = ProjectView(setup, polygon[i]);
+		}
+		auto toShade = [&shades](size_t i) { return static_cast<uint8_t>(shades[i] + 0.5f); };
+		for (size_t i = 1; i + 1 < count; i++)
+		{
+			out[i - 1] = Triangle{ { polygon[0], polygon[i], polygon[i + 1] }, filler, { toShade(0), toShade(i), toShade(i + 1) } };
+		}
+		return count - 2;
 	}
 
-	void Graphics::DrawTriangle(Triangle tri)
+	// at least capacity entries in the slot's triangle buffers, keeping the first TriCount triangles
+	static void GrowSlot(FrameSlot& slot, size_t capacity)
 	{
-		auto v3 = Point2{ static_cast<int>(tri.verts[2].x), static_cast<int>(tri.verts[2].y) };
-		auto v2 = Point2{ static_cast<int>(tri.verts[1].x), static_cast<int>(tri.verts[1].y) };
-		auto v1 = Point2{ static_cast<int>(tri.verts[0].x), static_cast<int>(tri.verts[0].y) };
-
-
-		if (v1.y > v2.y) std::swap(v1, v2);
-		if (v1.y > v3.y) std::swap(v1, v3);
-		if (v2.y > v3.y) std::swap(v2, v3);
+		if (capacity <= slot.Capacity)
+			return;
+		Triangle* tris = slot.Arena.Allocate<Triangle>(capacity);
+		uint32_t* source = slot.Arena.Allocate<uint32_t>(capacity + slot.QuadCapacity);
+		uint32_t* cells = slot.Arena.Allocate<uint32_t>(capacity + slot.QuadCapacity);
+		std::copy(slot.Tris, slot.Tris + slot.TriCount, tris);
+		std::copy(slot.Source, slot.Source + slot.TriCount, source);
+		std::copy(slot.Cells, slot.Cells + slot.TriCount, cells);
+		slot.Tris = tris;
+		slot.Source = source;
+		slot.Cells = cells;
+		slot.Keys = slot.Arena.Allocate<DepthKey>(capacity + slot.QuadCapacity);
+		slot.Scratch = slot.Arena.Allocate<DepthKey>(capacity + slot.QuadCapacity);
+		slot.Capacity = capacity;
+	}
 
+	// Replaces the first clipCount triangles listed in slot.Clip by their clipped pieces. The first piece takes
+	// the original's place, the rest go to the end with new ids, so the order stays the same from frame to frame.
+	// Clipped quads are cut into triangles the same way, all of their pieces go to the end.
+	// Runs once the vertex stage is done, it's the only part of it that can make more triangles than it got
+	static void ClipFaces(FrameSlot& slot, const VertexStageSetup& setup, size_t clipCount, size_t quadClipCount)
+	{
+		size_t extra{ 0 };
+		bool dropped{ false };
+		auto append = [&slot, &extra](const Triangle* pieces, size_t count)
+		{
+			if (slot.TriCount + count > slot.Capacity)
+				GrowSlot(slot, (slot.TriCount + count) * 2);
+			for (size_t piece = 0; piece < count; piece++)
+			{
+				slot.Tris[slot.TriCount] = pieces[piece];
+				slot.Source[slot.TriCount] = static_cast<uint32_t>(slot.MeshSize + extra++);
+				slot.Cells[slot.TriCount] = RasterFace;
+				slot.TriCount++;
+			}
+		};
+		for (size_t i = 0; i < clipCount; i++)
+		{
+			const uint32_t at{ slot.Clip[i] };
+			Triangle pieces[MaxClipTriangles];
+			const size_t count = ClipPolygon(setup, slot.Tris[at].verts, slot.Tris[at].shade, 3, slot.Tris[at].filler, pieces);
+			if (count == 0)
+			{
+				slot.Tris[at].filler = NoGlyph;
+				dropped = true;
+				continue;
+			}
+			slot.Tris[at] = pieces[0];
+			append(pieces + 1, count - 1);
+		}
 
-		// Вычисление общей высоты треугольника
-		float total_height = v3.y - v1.y;
+		for (size_t i = 0; i < quadClipCount; i++)
+		{
+			Quad& quad = slot.Quads[slot.QuadClip[i]];
+			Triangle pieces[MaxClipTriangles];
+			append(pieces, ClipPolygon(setup, quad.verts, quad.shade, 4, quad.filler, pieces));
+			quad.filler = NoGlyph;
+		}
+		if (quadClipCount > 0)
+		{
+			size_t kept{ 0 };
+			for (size_t i = 0; i < slot.QuadCount; i++)
+			{
+				if (slot.Quads[i].filler == NoGlyph)
+					continue;
+				slot.Quads[kept] = slot.Quads[i];
+				slot.QuadSource[kept] = slot.QuadSource[i];
+				slot.QuadCells[kept] = slot.QuadCells[i];
+				kept++;
+			}
+			slot.QuadCount = kept;
+		}
 
-		if (v2.y != v1.y) {
-			// Растеризация нижней половины треугольника
-			for (int y = v1.y; y <= v2.y; y++) {
-				float segment_height = v2.y - v1.y + 1;
-				if (total_height == 0 || segment_height == 0)
+		if (dropped)
+		{
+			size_t kept{ 0 };
+			for (size_t i = 0; i < slot.TriCount; i++)
+			{
+				if (slot.Tris[i].filler == NoGlyph)
 					continue;
-				float alpha = (total_height != 0) ? (y - v1.y) / total_height : 0;
-				float beta = (segment_height != 0) ? (y - v1.y) / segment_height : 0;
-				Vector3 A = interpolate(v1, v3, alpha);
-				Vector3 B = interpolate(v1, v2, beta);
+				slot.Tris[kept] = slot.Tris[i];
+				slot.Source[kept] = slot.Source[i];
+				slot.Cells[kept] = slot.Cells[i];
+				kept++;
+			}
+			slot.TriCount = kept;
+		}
+		slot.IdCount = slot.MeshSize + extra;
+	}
 
-				if (A.x > B.x) std::swap(A, B);
+	// least squares plane through values at the corners, in cells: exact for a triangle, the closest fit for a quad
+	// whose corners don't agree on one. Origin is at cell (0, 0)'s center
+	static void FitPlane(const Vector3* verts, const double* values, int corners, float& origin, float& dx, float& dy)
+	{
+		double cx{ 0.0 }, cy{ 0.0 }, cv{ 0.0 };
+		for (int i = 0; i < corners; i++)
+		{
+			cx += verts[i].x / corners;
+			cy += verts[i].y / corners;
+			cv += values[i] / corners;
+		}
+		double xx{ 0.0 }, xy{ 0.0 }, yy{ 0.0 }, xv{ 0.0 }, yv{ 0.0 };
+		for (int i = 0; i < corners; i++)
+		{
+			const double x{ verts[i].x - cx };
+			const double y{ verts[i].y - cy };
+			const double v{ values[i] - cv };
+			xx += x * x;
+			xy += x * y;
+			yy += y * y;
+			xv += x * v;
+			yv += y * v;
+		}
+		// a face with no area has no slope
+		const double det{ xx * yy - xy * xy };
+		double gx{ 0.0 };
+		double gy{ 0.0 };
+		if (det > 1e-9 * (xx + yy) * (xx + yy))
+		{
+			gx = (xv * yy - yv * xy) / det;
+			gy = (yv * xx - xv * xy) / det;
+		}
+		origin = static_cast<float>(cv + gx * (0.5 - cx) + gy * (0.5 - cy));
+		dx = static_cast<float>(gx);
+		dy = static_cast<float>(gy);
+	}
 
-				for (int x =  A.x; x <= B.x; x++) {
-					SetCursorPosition(COORD{ static_cast<short>(x), static_cast<short>(y) });
-					printw("%s", tri.filler);
-				}
-			}
+	// projected z is zLimit - zLimit * ZNear / w, so zLimit - z is 1 / w up to a scale, which the ratio drops
+	static ShadePlane FitShadePlane(const Vector3* verts, const uint8_t* shades, int corners, const SceneState& scene)
+	{
+		const double zLimit{ scene.View.ZFar / (scene.View.ZFar - scene.View.ZNear) };
+		double perW[4]{};
+		double shadePerW[4]{};
+		for (int i = 0; i < corners; i++)
+		{
+			perW[i] = scene.PerspectiveStep > 0 ? zLimit - verts[i].z : 1.0;
+			shadePerW[i] = shades[i] * perW[i];
 		}
-		if (v2.y == v3.y)
-			return;
-		// Растеризация верхней половины треугольника
-		for (int y = v2.y; y <= v3.y; y++) {
-			float segment_height = v3.y - v2.y + 1;
-			if (total_height == 0 || segment_height == 0)
+		ShadePlane plane{};
+		FitPlane(verts, shadePerW, corners, plane.Origin[0], plane.Dx[0], plane.Dy[0]);
+		FitPlane(verts, perW, corners, plane.Origin[1], plane.Dx[1], plane.Dy[1]);
+		return plane;
+	}
+
+	// the setup records of faces [record * SetupLanes, + SetupLanes), and their shade planes if smooth
+	static void SetupRecord(const FrameSlot& slot, size_t record)
+	{
+		const Vector3* verts[SetupLanes]{};
+		int corners[SetupLanes]{};
+		const size_t first{ record * SetupLanes };
+		const size_t count{ std::min(SetupLanes, slot.TriCount + slot.QuadCount - first) };
+		for (size_t lane = 0; lane < count; lane++)
+		{
+			const size_t face{ first + lane };
+			if (slot.Cells[face] != RasterFace) // splats don't need one
 				continue;
-			float alpha = (total_height != 0) ? (y - v1.y) / total_height : 0;
-			float beta = (segment_height != 0) ? (y - v2.y) / segment_height : 0;
-			Vector3 A = interpolate(v1, v3, alpha);
-			Vector3 B = interpolate(v2, v3, beta);
-			if (A.x > B.x) std::swap(A, B);
-			for (int x = A.x; x <= B.x; x++) {
-				SetCursorPosition(COORD{ static_cast<short>(x), static_cast<short>(y) });
-				printw("%s", tri.filler);
+			const bool quad{ face >= slot.TriCount };
+			verts[lane] = quad ? slot.Quads[face - slot.TriCount].verts : slot.Tris[face].verts;
+			corners[lane] = quad ? 4 : 3;
+			if (slot.ShadePlanes)
+			{
+				const uint8_t* shades = quad ? slot.Quads[face - slot.TriCount].shade : slot.Tris[face].shade;
+				slot.ShadePlanes[face] = FitShadePlane(verts[lane], shades, corners[lane], slot.Scene);
 			}
 		}
+		SetupFaces(verts, corners, count, slot.Setups[record]);
 	}
 
-	const char* Graphics::PixelIllumination(const Vector3& lightDir, const Vector3& normal)
+	void Graphics::SetupSlot(FrameSlot& slot)
 	{
-		float dp = DotProduct(normal, lightDir);
-		if(dp > 0.75f)
+		constexpr size_t ChunkRecords{ VertexChunkSize / SetupLanes };
+		const size_t records{ (slot.TriCount + slot.QuadCount + SetupLanes - 1) / SetupLanes };
+		m_Jobs.ParallelFor((records + ChunkRecords - 1) / ChunkRecords, [&slot, records](size_t chunk)
 		{
-			return "█";
-		}else if (dp > 0.5f)
+			for (size_t record = chunk * ChunkRecords; record < std::min(records, (chunk + 1) * ChunkRecords); record++)
+				SetupRecord(slot, record);
+		});
+	}
+
+	// a face goes to every band its rows touch, faces with nothing to draw to none; counting first keeps the lists
+	// in painter's order
+	static void BinFaces(FrameSlot& slot)
+	{
+		auto bandRange = [&slot](uint32_t index, int& first, int& last)
 		{
-			return "▓";
-		}else if (dp > 0.25f)
+			if (const uint32_t cell{ slot.Cells[index] }; cell != RasterFace)
+			{
+				first = last = static_cast<int>(cell / static_cast<uint32_t>(slot.Scene.ScreenWidth)) / slot.BandHeight;
+				return;
+			}
+			const FaceSetup& setup = slot.Setups[index / SetupLanes];
+			const size_t lane{ index % SetupLanes };
+			if (setup.Top[lane] > setup.Bottom[lane])
+			{
+				first = 0;
+				last = -1;
+				return;
+			}
+			first = std::clamp(setup.Top[lane] / slot.BandHeight, 0, static_cast<int>(slot.BandCount) - 1);
+			last = std::clamp(setup.Bottom[lane] / slot.BandHeight, 0, static_cast<int>(slot.BandCount) - 1);
+		};
+
+		const size_t faces{ slot.TriCount + slot.QuadCount };
+		std::fill(slot.BandStart, slot.BandStart + slot.BandCount + 1, 0);
+		for (size_t i = 0; i < faces; i++)
+		{
+			int first, last;
+			bandRange(slot.Keys[i].Index, first, last);
+			for (int band = first; band <= last; band++)
+				slot.BandStart[band + 1]++;
+		}
+		for (unsigned band = 0; band < slot.BandCount; band++)
 		{
-			return "▒";
-		}else if(dp > 0.0f) 
+			slot.BandStart[band + 1] += slot.BandStart[band];
+		}
+
+		// the slot's arena is only ever used by one job at a time, everything else ran before this one
+		slot.BandTris = slot.Arena.Allocate<uint32_t>(slot.BandStart[slot.BandCount]);
+		uint32_t* fill = slot.Arena.Allocate<uint32_t>(slot.BandCount);
+		std::copy(slot.BandStart, slot.BandStart + slot.BandCount, fill);
+		for (size_t i = 0; i < faces; i++)
 		{
-			return "░";
+			int first, last;
+			bandRange(slot.Keys[i].Index, first, last);
+			for (int band = first; band <= last; band++)
+				slot.BandTris[fill[band]++] = slot.Keys[i].Index;
 		}
+	}
+
+	// camera and model rotation of a scene, as the vertex stage wants them
+	static VertexStageSetup MakeVertexSetup(const SceneState& scene)
+	{
+		const float rotAngle{ scene.RotAngle };
+		const float zOffset{ scene.View.ZOffset };
+		const float fovRad{ 1.0f / tanf( scene.View.Fov * 0.5f / 180.0f * PI ) };
+		const float aspectRatio{ static_cast<float>(scene.ScreenHeight) / static_cast<float>(scene.ScreenWidth) };
+		const float zNear{ scene.View.ZNear };
+		const float zFar{ scene.View.ZFar };
+
+		VertexStageSetup setup{};
+		setup.ZOffset = zOffset;
+		setup.ZNear = zNear;
+		setup.Lights = scene.Lights;
+		setup.ScreenWidth = static_cast<float>(scene.ScreenWidth);
+		setup.ScreenHeight = static_cast<float>(scene.ScreenHeight);
+
+		// rotation matrix for 3d space - https://w.wiki/AjaZ
+		setup.RotX = Matrix4{
+			{
+				{1, 0, 0, 0},
+				{0, cosf(rotAngle * 0.5f), -sinf(rotAngle * 0.5f), 0},
+				{0, sinf(rotAngle * 0.5f), cosf(rotAngle * 0.5f), 0},
+				{0, 0, 0, 1}
+			}
+		};
+
+		setup.RotZ = Matrix4{
+			{
+				{cosf(rotAngle), -sinf(rotAngle), 0, 0},
+				{sinf(rotAngle), cosf(rotAngle), 0, 0},
+				{0, 0, 1, 0},
+				{0, 0, 0, 1},
+			}
+		};
+
+		setup.Proj = Matrix4{
+			{
+				{ aspectRatio * fovRad, 0, 0, 0 },
+				{	0, fovRad, 0, 0 },
+				{ 0, 0, zFar / (zFar - zNear),  1 },
+				{ 0, 0, (-zFar * zNear) / (zFar - zNear),0 },
+			}
+		};
+
+		return setup;
+	}
+
+	void Graphics::PrepareSlot(FrameSlot& slot, const SceneState& scene, size_t triangles, size_t quads, size_t chunks)
+	{
+		slot.Scene = scene;
+		slot.Submitted = std::chrono::steady_clock::now();
+
+		// every stage buffer of this frame comes from the slot's arena: sized for the worst case, no per-triangle growth
+		slot.Arena.Reset();
+		slot.MeshSize = triangles + quads;
+		slot.ChunkCount = 0; // AddChunks() fills them in
+		slot.Chunks = slot.Arena.Allocate<VertexChunk>(chunks);
+		slot.Tris = slot.Arena.Allocate<Triangle>(triangles);
+		slot.Quads = slot.Arena.Allocate<Quad>(quads);
+		slot.Source = slot.Arena.Allocate<uint32_t>(triangles + quads);
+		slot.QuadSource = slot.Arena.Allocate<uint32_t>(quads);
+		slot.Cells = slot.Arena.Allocate<uint32_t>(triangles + quads);
+		slot.QuadCells = slot.Arena.Allocate<uint32_t>(quads);
+		slot.ChunkOutput = slot.Arena.Allocate<size_t>(chunks);
+		slot.Clip = slot.Arena.Allocate<uint32_t>(triangles);
+		slot.QuadClip = slot.Arena.Allocate<uint32_t>(quads);
+		slot.ChunkClipped = slot.Arena.Allocate<size_t>(chunks);
+		slot.TriCount = 0;
+		slot.QuadCount = 0;
+		slot.Capacity = triangles;
+		slot.QuadCapacity = quads;
+		slot.IdCount = triangles + quads;
+		slot.Keys = slot.Arena.Allocate<DepthKey>(triangles + quads);
+		slot.Scratch = slot.Arena.Allocate<DepthKey>(triangles + quads);
+		slot.BandCount = std::max(1u, std::min({ MaxRasterBands, m_Jobs.Size() * 2,
+		                                         static_cast<unsigned>(scene.ScreenHeight) }));
+		slot.BandHeight = (scene.ScreenHeight + static_cast<int>(slot.BandCount) - 1) / static_cast<int>(slot.BandCount);
+		slot.BandStart = slot.Arena.Allocate<uint32_t>(slot.BandCount + 1);
+		slot.BandTris = nullptr;
+		slot.ShadePlanes = nullptr;
+		slot.VertexDraws = nullptr;
+		slot.VertexDrawCount = 0;
+		slot.VertexCount = 0;
+	}
+
+	size_t Graphics::ChunksOf(const Mesh& mesh)
+	{
+		return (mesh.Tris.size() + VertexChunkSize - 1) / VertexChunkSize + (mesh.Quads.size() + VertexChunkSize - 1) / VertexChunkSize;
+	}
+
+	void Graphics::AddChunks(FrameSlot& slot, const VertexStageSetup& setup, const Mesh& mesh, const Vector3* normals,
+	                         size_t& triOut, size_t& quadOut)
+	{
+		const uint32_t* corners{ nullptr };
+		const uint8_t* shades{ nullptr };
+		if (slot.Scene.Raster == RasterMode::Smooth)
+		{
+			const VertexDraw& draw = slot.VertexDraws[slot.VertexDrawCount - 1];
+			corners = draw.Data->Corners.data();
+			shades = slot.Shades + draw.Out;
+		}
+		for (size_t begin = 0; begin < mesh.Tris.size(); begin += VertexChunkSize)
+		{
+			slot.Chunks[slot.ChunkCount++] = VertexChunk{
+				&setup, &mesh, normals, corners, shades, false, begin, std::min(begin + VertexChunkSize, mesh.Tris.size()),
+				triOut + begin
+			};
+		}
+		// a mesh's quads' corners come after its triangles'
+		if (corners)
+			corners += mesh.Tris.size() * 3;
+		for (size_t begin = 0; begin < mesh.Quads.size(); begin += VertexChunkSize)
+		{
+			slot.Chunks[slot.ChunkCount++] = VertexChunk{
+				&setup, &mesh, normals, corners, shades, true, begin, std::min(begin + VertexChunkSize, mesh.Quads.size()),
+				quadOut + begin
+			};
+		}
+		triOut += mesh.Tris.size();
+		quadOut += mesh.Quads.size();
+	}
+
+	void Graphics::PrepareVertices(FrameSlot& slot, size_t draws, size_t vertices)
+	{
+		const bool edges{ slot.Scene.Raster == RasterMode::Edges };
+		slot.VertexDraws = slot.Arena.Allocate<VertexDraw>(draws);
+		slot.VertexDrawCount = 0; // AddVertexDraw() fills them in
+		slot.VertexCount = 0;
+		slot.ViewPoints = edges ? slot.Arena.Allocate<Vector3>(vertices) : nullptr;
+		slot.ScreenPoints = edges ? slot.Arena.Allocate<Vector3>(vertices) : nullptr;
+		slot.Shades = edges ? nullptr : slot.Arena.Allocate<uint8_t>(vertices);
+	}
+
+	void Graphics::AddVertexDraw(FrameSlot& slot, const VertexStageSetup& setup, const MeshData& data)
+	{
+		slot.VertexDraws[slot.VertexDrawCount++] = VertexDraw{ &setup, &data, slot.VertexCount };
+		slot.VertexCount += data.Vertices.size();
+	}
+
+	void Graphics::TransformChunk(FrameSlot& slot, size_t chunk)
+	{
+		const VertexChunk& work = slot.Chunks[chunk];
+		if (!work.Quads)
+		{
+			slot.ChunkOutput[chunk] = TransformFaces(*work.Setup, work.Source->Tris, work.Begin, work.End, slot.Tris + work.Out,
+			                                         slot.Source + work.Out, slot.Cells + work.Out, slot.Clip + work.Out,
+			                                         slot.ChunkClipped[chunk], work.Normals, work.Corners, work.Shades);
+			return;
+		}
+
+		// a mesh's face normals and ids have its quads after its triangles
+		const size_t triangles{ work.Source->Tris.size() };
+		const size_t count = TransformFaces(*work.Setup, work.Source->Quads, work.Begin, work.End, slot.Quads + work.Out,
+		                                    slot.QuadSource + work.Out, slot.QuadCells + work.Out, slot.QuadClip + work.Out,
+		                                    slot.ChunkClipped[chunk], work.Normals ? work.Normals + triangles : nullptr,
+		                                    work.Corners, work.Shades);
+		for (size_t i = 0; i < count; i++)
+			slot.QuadSource[work.Out + i] += static_cast<uint32_t>(triangles);
+		slot.ChunkOutput[chunk] = count;
+	}
+
+	// after the vertex stage: packs the chunks' output, clips and writes the depth keys.
+	// setup is the camera the clipped faces' view space is in
+	static void FinishGeometry(FrameSlot& slot, const VertexStageSetup& setup)
+	{
+		// each chunk wrote into its own slice (the slice its input came from, so it always fits),
+		// packing them in chunk order gives the same output as a single threaded loop
+		size_t triCount{ 0 };
+		size_t quadCount{ 0 };
+		size_t clipCount{ 0 };
+		size_t quadClipCount{ 0 };
+		for (size_t chunk = 0; chunk < slot.ChunkCount; chunk++)
+		{
+			const size_t begin{ slot.Chunks[chunk].Out };
+			const size_t written{ slot.ChunkOutput[chunk] };
+			if (slot.Chunks[chunk].Quads)
+			{
+				for (size_t i = 0; i < slot.ChunkClipped[chunk]; i++)
+					slot.QuadClip[quadClipCount++] = static_cast<uint32_t>(quadCount + slot.QuadClip[begin + i]);
+				std::copy(slot.Quads + begin, slot.Quads + begin + written, slot.Quads + quadCount);
+				std::copy(slot.QuadSource + begin, slot.QuadSource + begin + written, slot.QuadSource + quadCount);
+				std::copy(slot.QuadCells + begin, slot.QuadCells + begin + written, slot.QuadCells + quadCount);
+				quadCount += written;
+				continue;
+			}
+			for (size_t i = 0; i < slot.ChunkClipped[chunk]; i++)
+				slot.Clip[clipCount++] = static_cast<uint32_t>(triCount + slot.Clip[begin + i]);
+			std::copy(slot.Tris + begin, slot.Tris + begin + written, slot.Tris + triCount);
+			std::copy(slot.Source + begin, slot.Source + begin + written, slot.Source + triCount);
+			std::copy(slot.Cells + begin, slot.Cells + begin + written, slot.Cells + triCount);
+			triCount += written;
+		}
+		slot.TriCount = triCount;
+		slot.QuadCount = quadCount;
+		ClipFaces(slot, setup, clipCount, quadClipCount);
+		triCount = slot.TriCount;
+		quadCount = slot.QuadCount;
+
+		// painter's order: sort 8 byte keys (depth + index), the faces stay where they are. Quads are
+		// TriCount + their index. Sum of z orders the same as the centroid, no need to divide by 3;
+		// a quad's sum is scaled to match
+		for (size_t i = 0; i < triCount; i++)
+		{
+			const Triangle& tri = slot.Tris[i];
+			slot.Keys[i] = DepthKey{ DepthSortKey(tri.verts[0].z + tri.verts[1].z + tri.verts[2].z), static_cast<uint32_t>(i) };
+		}
+		for (size_t i = 0; i < quadCount; i++)
+		{
+			const Quad& quad = slot.Quads[i];
+			const float depth{ (quad.verts[0].z + quad.verts[1].z + quad.verts[2].z + quad.verts[3].z) * 0.75f };
+			slot.Keys[triCount + i] = DepthKey{ DepthSortKey(depth), static_cast<uint32_t>(triCount + i) };
+		}
+		std::copy(slot.QuadSource, slot.QuadSource + quadCount, slot.Source + triCount);
+		std::copy(slot.QuadCells, slot.QuadCells + quadCount, slot.Cells + triCount);
+		slot.Setups = slot.Arena.Allocate<FaceSetup>((triCount + quadCount + SetupLanes - 1) / SetupLanes);
+		if (slot.Scene.Raster == RasterMode::Smooth)
+			slot.ShadePlanes = slot.Arena.Allocate<ShadePlane>(triCount + quadCount);
+	}
+
+	void Graphics::SubmitGeometry(const SceneState& scene, FrameSlot& slot)
+	{
+		if (scene.Raster == RasterMode::Edges)
+		{
+			// no faces, no sort: the mesh's vertices through the vertex stage once, RasterSlot() draws the edges
+			PrepareSlot(slot, scene, 0, 0, 0);
+			slot.Setup = MakeVertexSetup(scene);
+			const MeshData& data = SharedMeshData(Model);
+			PrepareVertices(slot, 1, data.Vertices.size());
+			AddVertexDraw(slot, slot.Setup, data);
+			slot.Geometry = m_Jobs.Create("points", [this, &slot] { TransformPoints(slot); });
+			m_Jobs.Submit(slot.Geometry);
+			return;
+		}
+
+		PrepareSlot(slot, scene, Model.Tris.size(), Model.Quads.size(), ChunksOf(Model));
+		slot.Setup = MakeVertexSetup(scene);
+		const bool smooth{ scene.Raster == RasterMode::Smooth };
+		if (smooth)
+		{
+			const MeshData& data = SharedMeshData(Model);
+			PrepareVertices(slot, 1, data.Vertices.size());
+			AddVertexDraw(slot, slot.Setup, data);
+		}
+		size_t triOut{ 0 };
+		size_t quadOut{ 0 };
+		AddChunks(slot, slot.Setup, Model, nullptr, triOut, quadOut);
+
+		// transform chunks -> compact + keys -> sort and setup -> bin; RasterSlot() takes it from there
+		Job* keys = m_Jobs.Create("keys", [&slot] { FinishGeometry(slot, slot.Setup); });
+		if (smooth)
+		{
+			// faces read their vertices' shades: the vertices go first, then the chunks in one parallel for
+			Job* transform = m_Jobs.Create("shade and transform", [this, &slot]
+			{
+				ShadeVertices(slot);
+				m_Jobs.ParallelFor(slot.ChunkCount, [this, &slot](size_t chunk) { TransformChunk(slot, chunk); });
+			});
+			m_Jobs.DependsOn(keys, transform);
+			// the light cache goes from frame to frame like the sort's order: frames in flight shade one after another
+			for (unsigned i = 0; i < m_PendingCount; i++)
+				m_Jobs.DependsOn(transform, m_Slots[(m_PendingFirst + i) % MaxPipelineDepth].Geometry);
+			m_Jobs.Submit(transform);
+		}
+		for (size_t chunk = 0; chunk < slot.ChunkCount && !smooth; chunk++)
+		{
+			Job* transform = m_Jobs.Create("transform", [this, &slot, chunk] { TransformChunk(slot, chunk); });
+			m_Jobs.DependsOn(keys, transform);
+			m_Jobs.Submit(transform);
+		}
+
+		Job* sort = m_Jobs.Create("sort", [this, &slot]
+		{
+			if (m_SortedMeshVersion != slot.Scene.MeshVersion) // last frame's order is about a different mesh
+			{
+				m_DepthSort.Invalidate();
+				m_SortedMeshVersion = slot.Scene.MeshVersion;
+			}
+			m_DepthSort.Sort(slot.Keys, slot.Scratch, slot.Source, slot.TriCount + slot.QuadCount, slot.IdCount, &m_Jobs);
+			slot.Sort = m_DepthSort.Stats();
+		});
+		m_Jobs.DependsOn(sort, keys);
+		// the coherent sort carries its order from frame to frame, so frames in flight sort one after another
+		if (m_PendingCount > 0)
+			m_Jobs.DependsOn(sort, m_Slots[(m_PendingFirst + m_PendingCount - 1) % MaxPipelineDepth].Geometry);
+
+		Job* setup = m_Jobs.Create("setup", [this, &slot] { SetupSlot(slot); });
+		m_Jobs.DependsOn(setup, keys);
+
+		slot.Geometry = m_Jobs.Create("bin", [&slot] { BinFaces(slot); });
+		m_Jobs.DependsOn(slot.Geometry, sort);
+		m_Jobs.DependsOn(slot.Geometry, setup);
+
+		m_Jobs.Submit(keys);
+		m_Jobs.Submit(sort);
+		m_Jobs.Submit(setup);
+		m_Jobs.Submit(slot.Geometry);
+	}
+
+	void Graphics::RasterSlot(const FrameSlot& slot)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		if (m_Frame.Width() != slot.Scene.ScreenWidth || m_Frame.Height() != slot.Scene.ScreenHeight)
+			m_Frame.Resize(slot.Scene.ScreenWidth, slot.Scene.ScreenHeight);
+		Clear();
+
+		// front to back: the band lists backwards, every cell is written by the first face that reaches it, which is
+		// the one painter's order would have written last. Same image, each cell written once
+		if (slot.Scene.FrontToBack)
+			m_Coverage.Reset(slot.Scene.ScreenWidth, slot.Scene.ScreenHeight);
+		m_PerspectiveStep = slot.Scene.PerspectiveStep;
+
+		// bands cover disjoint rows, so they never write the same cell
+		std::atomic<size_t> fragments{ 0 };
+		auto finish = [&]
+		{
+			m_RasterStats = RasterStats{
+				fragments.load(), static_cast<size_t>(std::count(m_Covered.begin(), m_Covered.end(), 1)),
+				std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count()
+			};
+		};
+		if (slot.Scene.Raster == RasterMode::Edges)
+		{
+			m_Jobs.ParallelFor(slot.BandCount, [this, &slot, &fragments](size_t band)
+			{
+				fragments.fetch_add(DrawEdges(slot, band), std::memory_order_relaxed);
+			});
+			finish();
+			return;
+		}
+
+		// one kernel per mode and order, picked here once: the per cell loops don't test either of them
+		using BandKernel = size_t (Graphics::*)(const FrameSlot&, size_t);
+		static constexpr BandKernel kernels[4][2]{
+			{ &Graphics::RasterBand<RasterMode::Flat, false>, &Graphics::RasterBand<RasterMode::Flat, true> },
+			{ &Graphics::RasterBand<RasterMode::Smooth, false>, &Graphics::RasterBand<RasterMode::Smooth, true> },
+			{ &Graphics::RasterBand<RasterMode::Wireframe, false>, &Graphics::RasterBand<RasterMode::Wireframe, true> },
+			{ &Graphics::RasterBand<RasterMode::DepthOnly, false>, &Graphics::RasterBand<RasterMode::DepthOnly, true> },
+		};
+		const BandKernel kernel{ kernels[static_cast<size_t>(slot.Scene.Raster)][slot.Scene.FrontToBack ? 1 : 0] };
+		m_Jobs.ParallelFor(slot.BandCount, [this, &slot, &fragments, kernel](size_t band)
+		{
+			fragments.fetch_add((this->*kernel)(slot, band), std::memory_order_relaxed);
+		});
+		finish();
+	}
+
+	template <RasterMode Mode, bool FrontToBack>
+	size_t Graphics::RasterBand(const FrameSlot& slot, size_t band)
+	{
+		const int width{ slot.Scene.ScreenWidth };
+		const int minY = static_cast<int>(band) * slot.BandHeight;
+		const int maxY = std::min(minY + slot.BandHeight, static_cast<int>(slot.Scene.ScreenHeight)) - 1;
+		size_t open = static_cast<size_t>(std::max(maxY - minY + 1, 0)) * width;
+		size_t written{ 0 };
+		for (uint32_t n = slot.BandStart[band]; n < slot.BandStart[band + 1]; n++)
+		{
+			const uint32_t face{ slot.BandTris[FrontToBack ? slot.BandStart[band + 1] - 1 - (n - slot.BandStart[band]) : n] };
+			const bool quad{ face >= slot.TriCount };
+			const Glyph filler = quad ? slot.Quads[face - slot.TriCount].filler : slot.Tris[face].filler;
+			ColorPair colors{ DefaultColors };
+			if (m_Colored)
+			{
+				// the average of its corners' shades, like a smooth splat's glyph
+				const uint8_t* shade = quad ? slot.Quads[face - slot.TriCount].shade : slot.Tris[face].shade;
+				const unsigned corners{ quad ? 4u : 3u };
+				unsigned sum{ 0 };
+				for (unsigned i = 0; i < corners; i++)
+					sum += shade[i];
+				colors = m_ShadeColors[sum / corners];
+			}
+			size_t cells{ 0 };
+			if (const uint32_t cell{ slot.Cells[face] }; cell != RasterFace)
+			{
+				// smaller than a cell: the vertex stage already found the one cell it covers. Its outline is the cell
+				const int row = static_cast<int>(cell) / width;
+				const int column = static_cast<int>(cell) % width;
+				// a smooth one's glyph is the average of its corners' shades
+				constexpr RasterMode SplatMode{ Mode == RasterMode::Smooth ? RasterMode::Flat : Mode };
+				cells = WriteSpan<SplatMode, FrontToBack>(row, column, column, filler, nullptr, colors);
+			}
+			else
+			{
+				cells = DrawPolygon<Mode, FrontToBack>(slot.Setups[face / SetupLanes], face % SetupLanes, filler, minY, maxY,
+				                                       Mode == RasterMode::Smooth ? slot.ShadePlanes + face : nullptr, colors);
+			}
+			written += cells;
+
+			// every cell of the band is final, nothing behind can show anymore
+			if (FrontToBack && (open -= cells) == 0)
+				break;
+		}
+		return written;
+	}
+
+	// a world space point through the vertex stage into view space, without culling or lighting
+	static Vector3 ViewPoint(const VertexStageSetup& setup, const Vector3& point)
+	{
+		Vector3 view = point * setup.RotZ * setup.RotX;
+		view.z += setup.ZOffset;
+		return view;
+	}
+
+	// cuts the part of a view space segment behind the near plane, false if nothing is left
+	static bool ClipSegment(float zNear, Vector3& start, Vector3& end)
+	{
+		if (start.z < zNear && end.z < zNear)
+			return false;
+		if (start.z < zNear || end.z < zNear)
+		{
+			Vector3& behind = start.z < zNear ? start : end;
+			const Vector3& front = start.z < zNear ? end : start;
+			const float t{ (zNear - front.z) / (behind.z - front.z) };
+			behind = Vector3{ front.x + (behind.x - front.x) * t, front.y + (behind.y - front.y) * t, zNear };
+		}
+		return true;
+	}
+
+	static short ToCell(float coord)
+	{
+		return static_cast<short>(std::clamp(coord, -16384.0f, 16384.0f)); // far off screen is still off screen
+	}
+
+	// the part of a screen space segment inside [left, right] x [top, bottom], false if there's none (Liang-Barsky)
+	static bool ClipToRect(float left, float top, float right, float bottom, Vector3& start, Vector3& end)
+	{
+		const float dx{ end.x - start.x };
+		const float dy{ end.y - start.y };
+		const float p[4]{ -dx, dx, -dy, dy };
+		const float q[4]{ start.x - left, right - start.x, start.y - top, bottom - start.y };
+		float t0{ 0.0f };
+		float t1{ 1.0f };
+		for (int i = 0; i < 4; i++)
+		{
+			if (p[i] == 0.0f)
+			{
+				if (q[i] < 0.0f) // parallel to this side and outside it
+					return false;
+				continue;
+			}
+			const float t{ q[i] / p[i] };
+			if (p[i] < 0.0f)
+				t0 = std::max(t0, t);
+			else
+				t1 = std::min(t1, t);
+		}
+		if (t0 > t1)
+			return false;
+		const Vector3 from{ start };
+		start = Vector3{ from.x + dx * t0, from.y + dy * t0, from.z };
+		end = Vector3{ from.x + dx * t1, from.y + dy * t1, end.z };
+		return true;
+	}
+
+	// vertices [begin, end) of the frame's vertex draws, body(draw, first, last) for the part in each draw
+	template <typename Body>
+	static void ForEachDrawRange(const FrameSlot& slot, size_t begin, size_t end, Body&& body)
+	{
+		// the draw begin is in; draws are in vertex order
+		size_t draw = std::upper_bound(slot.VertexDraws, slot.VertexDraws + slot.VertexDrawCount, begin,
+		                               [](size_t vertex, const VertexDraw& d) { return vertex < d.Out; }) - slot.VertexDraws - 1;
+		while (begin < end)
+		{
+			const VertexDraw& work = slot.VertexDraws[draw++];
+			const size_t last{ std::min(end, work.Out + work.Data->Vertices.size()) };
+			body(work, begin, last);
+			begin = last;
+		}
+	}
+
+	void Graphics::TransformPoints(FrameSlot& slot)
+	{
+		m_Jobs.ParallelFor((slot.VertexCount + VertexChunkSize - 1) / VertexChunkSize, [&slot](size_t chunk)
+		{
+			const size_t begin{ chunk * VertexChunkSize };
+			ForEachDrawRange(slot, begin, std::min(begin + VertexChunkSize, slot.VertexCount),
+			                 [&slot](const VertexDraw& work, size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					const Vector3 view = ViewPoint(*work.Setup, work.Data->Vertices[i - work.Out]);
+					slot.ViewPoints[i] = view;
+					slot.ScreenPoints[i] = view.z >= work.Setup->ZNear ? ProjectView(*work.Setup, view) : Vector3{};
+				}
+			});
+		});
+	}
+
+	// the light at vertices [first, first + count) of a draw, quantized to 0-255. One vertex per lane and a loop over
+	// the lights: plain loops over the axis arrays of a batch, which the compiler vectorizes
+	static void LightVertices(const VertexDraw& draw, size_t first, size_t count, const LightSet& lights, uint8_t* shades)
+	{
+		const MeshData& data = *draw.Data;
+		const Matrix4 transform = draw.Setup->RotZ * draw.Setup->RotX;
+		const float (&m)[4][4] = transform.m;
+		// normals only turn; a uniform scale stretches all of them the same and is divided out here
+		const float unscale{ 1.0f / std::sqrt(m[0][0] * m[0][0] + m[0][1] * m[0][1] + m[0][2] * m[0][2]) };
+		bool points{ false };
+		for (size_t l = 0; l < lights.Count; l++)
+			points = points || lights.Items[l].Type == LightType::Point;
+
+		constexpr size_t Batch{ 256 };
+		float x[Batch], y[Batch], z[Batch];
+		float px[Batch], py[Batch], pz[Batch];
+		float light[Batch];
+		for (size_t begin = 0; begin < count; begin += Batch)
+		{
+			const size_t n{ std::min(Batch, count - begin) };
+			const float* nx = data.NormalX.data() + first + begin;
+			const float* ny = data.NormalY.data() + first + begin;
+			const float* nz = data.NormalZ.data() + first + begin;
+			for (size_t i = 0; i < n; i++)
+			{
+				x[i] = (nx[i] * m[0][0] + ny[i] * m[1][0] + nz[i] * m[2][0]) * unscale;
+				y[i] = (nx[i] * m[0][1] + ny[i] * m[1][1] + nz[i] * m[2][1]) * unscale;
+				z[i] = (nx[i] * m[0][2] + ny[i] * m[1][2] + nz[i] * m[2][2]) * unscale;
+				light[i] = 0.0f;
+			}
+			if (points) // where the vertices are, in view space like ViewPoint()
+			{
+				const Vector3* position = data.Vertices.data() + first + begin;
+				for (size_t i = 0; i < n; i++)
+				{
+					px[i] = position[i].x * m[0][0] + position[i].y * m[1][0] + position[i].z * m[2][0] + m[3][0];
+					py[i] = position[i].x * m[0][1] + position[i].y * m[1][1] + position[i].z * m[2][1] + m[3][1];
+					pz[i] = position[i].x * m[0][2] + position[i].y * m[1][2] + position[i].z * m[2][2] + m[3][2] + draw.Setup->ZOffset;
+				}
+			}
+
+			for (size_t l = 0; l < lights.Count; l++)
+			{
+				const Light& source = lights.Items[l];
+				const float intensity{ source.Intensity };
+				if (source.Type == LightType::Directional)
+				{
+					const Vector3 d = source.Direction;
+					for (size_t i = 0; i < n; i++)
+						light[i] += intensity * std::max(x[i] * d.x + y[i] * d.y + z[i] * d.z, 0.0f);
+					continue;
+				}
+				const Vector3 p = source.Position;
+				for (size_t i = 0; i < n; i++)
+				{
+					const float lx{ p.x - px[i] };
+					const float ly{ p.y - py[i] };
+					const float lz{ p.z - pz[i] };
+					const float dp{ x[i] * lx + y[i] * ly + z[i] * lz };
+					// no branch, so the loop stays vectorized; at the light itself dp is 0 and so is the light
+					const float distance{ std::sqrt(std::max(lx * lx + ly * ly + lz * lz, 1e-12f)) };
+					light[i] += intensity * std::max(dp, 0.0f) / distance;
+				}
+			}
+
+			// negative intensities can take the sum below 0. max(0, NaN) is 0 as well
+			for (size_t i = 0; i < n; i++)
+				shades[begin + i] = static_cast<uint8_t>(std::min(std::max(0.0f, light[i]), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	void Graphics::ShadeVertices(FrameSlot& slot)
+	{
+		// a draw lit exactly like the one at its index last time copies its shades, the rest are lit
+		VertexLightCache& cache = m_VertexLight;
+		const bool sameLights{ SameLights(cache.Lights, slot.Scene.Lights) };
+		const VertexLightCache::Draw** reuse = slot.Arena.Allocate<const VertexLightCache::Draw*>(slot.VertexDrawCount);
+		size_t reused{ 0 };
+		for (size_t d = 0; d < slot.VertexDrawCount; d++)
+		{
+			const VertexDraw& draw = slot.VertexDraws[d];
+			const VertexLightCache::Draw* last = d < cache.Draws.size() ? &cache.Draws[d] : nullptr;
+			const bool same{ sameLights && last && last->Data == draw.Data && last->Version == draw.Data->Version &&
+			                 SameMatrix(last->RotX, draw.Setup->RotX) && SameMatrix(last->RotZ, draw.Setup->RotZ) &&
+			                 last->ZOffset == draw.Setup->ZOffset };
+			reuse[d] = same ? last : nullptr;
+			reused += same ? 1 : 0;
+		}
+
+		m_Jobs.ParallelFor((slot.VertexCount + VertexChunkSize - 1) / VertexChunkSize, [&slot, &cache, reuse](size_t chunk)
+		{
+			const size_t begin{ chunk * VertexChunkSize };
+			ForEachDrawRange(slot, begin, std::min(begin + VertexChunkSize, slot.VertexCount),
+			                 [&slot, &cache, reuse](const VertexDraw& work, size_t first, size_t last)
+			{
+				if (const VertexLightCache::Draw* lit = reuse[&work - slot.VertexDraws])
+					std::memcpy(slot.Shades + first, cache.Shades.data() + lit->Out + (first - work.Out), last - first);
+				else
+					LightVertices(work, first - work.Out, last - first, slot.Scene.Lights, slot.Shades + first);
+			});
+		});
+
+		if (reused == slot.VertexDrawCount && cache.Draws.size() == slot.VertexDrawCount)
+			return;
+		cache.Lights = slot.Scene.Lights;
+		cache.Draws.resize(slot.VertexDrawCount);
+		for (size_t d = 0; d < slot.VertexDrawCount; d++)
+		{
+			const VertexDraw& draw = slot.VertexDraws[d];
+			cache.Draws[d] = VertexLightCache::Draw{
+				draw.Data, draw.Data->Version, draw.Setup->RotX, draw.Setup->RotZ, draw.Setup->ZOffset, draw.Out
+			};
+		}
+		cache.Shades.assign(slot.Shades, slot.Shades + slot.VertexCount);
+	}
+
+	// every edge of every draw that reaches the band's rows, each one once: the index buffer has no duplicates
+	size_t Graphics::DrawEdges(const FrameSlot& slot, size_t band)
+	{
+		const int width{ slot.Scene.ScreenWidth };
+		const int height{ slot.Scene.ScreenHeight };
+		const int minY = static_cast<int>(band) * slot.BandHeight;
+		const int maxY = std::min(minY + slot.BandHeight, height) - 1;
+		size_t written{ 0 };
+		for (size_t d = 0; d < slot.VertexDrawCount; d++)
+		{
+			const VertexDraw& draw = slot.VertexDraws[d];
+			const VertexStageSetup& setup = *draw.Setup;
+			const Vector3* view = slot.ViewPoints + draw.Out;
+			const Vector3* screen = slot.ScreenPoints + draw.Out;
+			for (const MeshEdge& edge : draw.Data->Edges)
+			{
+				Vector3 start{ screen[edge.A] };
+				Vector3 end{ screen[edge.B] };
+				if (view[edge.A].z < setup.ZNear || view[edge.B].z < setup.ZNear)
+				{
+					start = view[edge.A];
+					end = view[edge.B];
+					if (!ClipSegment(setup.ZNear, start, end))
+						continue;
+					start = ProjectView(setup, start);
+					end = ProjectView(setup, end);
+				}
+				else if (std::max(start.y, end.y) < minY || std::min(start.y, end.y) >= maxY + 1)
+				{
+					continue; // the common case, rejected before any clipping
+				}
+
+				// a cell past every side is enough for the ends to stay off screen, and keeps them in int range
+				if (!ClipToRect(-1.0f, -1.0f, static_cast<float>(width), static_cast<float>(height), start, end))
+					continue;
+				const int x0 = static_cast<int>(std::floor(start.x));
+				const int y0 = static_cast<int>(std::floor(start.y));
+				const int x1 = static_cast<int>(std::floor(end.x));
+				const int y1 = static_cast<int>(std::floor(end.y));
+
+				// the glyph follows the slope
+				const int dx{ x1 - x0 };
+				const int dy{ y1 - y0 };
+				const Glyph glyph = 2 * std::abs(dy) <= std::abs(dx) ? '-'
+				                  : 2 * std::abs(dx) <= std::abs(dy) ? '|'
+				                  : (dx > 0) == (dy > 0) ? '\\' : '/';
+				written += DrawSegment(x0, y0, x1, y1, glyph, minY, maxY);
+			}
+		}
+		return written;
+	}
+
+	// Bresenham without the stepping: the cells of row k are the ones whose column rounds to it, worked out directly
+	// from the integer slope so every row is one span, and bands can start at any row
+	size_t Graphics::DrawSegment(int x0, int y0, int x1, int y1, Glyph glyph, int minY, int maxY)
+	{
+		if (y0 > y1)
+		{
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+		}
+		const int64_t dx{ std::abs(int64_t{ x1 } - x0) };
+		const int64_t dy{ int64_t{ y1 } - y0 };
+		const int64_t step{ x1 < x0 ? -1 : 1 };
+		const int firstRow = std::max({ y0, minY, 0 });
+		const int lastRow = std::min({ y1, maxY, m_Frame.Height() - 1 });
+		const int64_t lastColumn = m_Frame.Width() - 1;
+		size_t written{ 0 };
+		for (int row = firstRow; row <= lastRow; row++)
+		{
+			// steps i along x with round(i * dy / dx) == k, or the one i = round(k * dx / dy) if y is the long axis
+			const int64_t k{ row - y0 };
+			int64_t first{ 0 };
+			int64_t last{ dx };
+			if (dx > dy)
+			{
+				first = k == 0 ? 0 : CeilDiv((2 * k - 1) * dx, 2 * dy);
+				last = k == dy ? dx : CeilDiv((2 * k + 1) * dx, 2 * dy) - 1;
+			}
+			else if (dy > 0)
+			{
+				first = last = FloorDiv(2 * k * dx + dy, 2 * dy);
+			}
+			const int64_t left = step > 0 ? x0 + first : x0 - last;
+			const int64_t right = step > 0 ? x0 + last : x0 - first;
+			written += WriteSpan<RasterMode::Flat, false>(row, static_cast<int>(std::max<int64_t>(left, 0)),
+			                                              static_cast<int>(std::min(right, lastColumn)), glyph);
+		}
+		return written;
+	}
+
+	void Graphics::Submit(const CommandBuffer* buffers, size_t count, const FrameTiming& timing)
+	{
+		Flush(); // frames Draw() still has in flight go out first, they can't land on top of this one
+		m_LastTiming = timing;
+
+		// no model rotation: RotX stays identity, RotZ takes each draw's world transform
+		const SceneState scene{
+			0.0f, View, SceneLights(), 0, m_ScreenWidth, m_ScreenHeight, FrontToBack, Raster, PerspectiveStep
+		};
+		const VertexStageSetup camera = MakeVertexSetup(scene);
+
+		// instances are culled up front, only the visible ones become draws
+		const Frustum frustum = Frustum::FromCamera(View, m_ScreenWidth, m_ScreenHeight);
+		m_VisibleInstances.clear();
+		m_VisibleRuns.clear();
+		size_t draws{ 0 };
+		size_t triangles{ 0 };
+		size_t quads{ 0 };
+		size_t chunks{ 0 };
+		size_t vertices{ 0 };
+		const bool edges{ scene.Raster == RasterMode::Edges };
+		const bool smooth{ scene.Raster == RasterMode::Smooth };
+		for (size_t b = 0; b < count; b++)
+		{
+			for (const Command& command : buffers[b].Commands())
+			{
+				size_t instances{ 1 };
+				if (command.Type == CommandType::DrawInstanced)
+				{
+					const size_t first = m_VisibleInstances.size();
+					m_VisibleInstances.resize(first + command.Count);
+					instances = CullInstances(SharedMeshData(buffers[b].MeshAt(command.Index)).LocalBounds,
+					                          &buffers[b].Transform(command.First), command.Count, frustum,
+					                          m_VisibleInstances.data() + first);
+					m_VisibleInstances.resize(first + instances);
+					m_VisibleRuns.push_back(instances);
+				}
+				else if (command.Type != CommandType::DrawMesh)
+					continue;
+				const Mesh& mesh = buffers[b].MeshAt(command.Index);
+				draws += instances;
+				triangles += mesh.Tris.size() * instances;
+				quads += mesh.Quads.size() * instances;
+				chunks += ChunksOf(mesh) * instances;
+				if (edges || smooth)
+					vertices += SharedMeshData(mesh).Vertices.size() * instances;
+			}
+		}
+
+		FrameSlot& slot = m_Slots[m_PendingFirst]; // the pipeline is empty, any slot is free
+		if (edges)
+			PrepareSlot(slot, scene, 0, 0, 0);
+		else
+			PrepareSlot(slot, scene, triangles, quads, chunks);
+		if (edges || smooth)
+			PrepareVertices(slot, draws, vertices);
+
+		// every chunk of every draw is one work item; each writes into its own slice like in SubmitGeometry()
+		VertexStageSetup* setups = slot.Arena.Allocate<VertexStageSetup>(draws);
+		size_t draw{ 0 };
+		size_t triOut{ 0 };
+		size_t quadOut{ 0 };
+		size_t visible{ 0 };
+		size_t run{ 0 };
+		auto addDraw = [&](const Mesh& mesh, const Matrix4& world, const Vector3* normals)
+		{
+			setups[draw] = camera;
+			setups[draw].RotZ = world;
+			if (edges || smooth)
+				AddVertexDraw(slot, setups[draw], SharedMeshData(mesh));
+			if (!edges)
+				AddChunks(slot, setups[draw], mesh, normals, triOut, quadOut);
+			draw++;
+		};
+		for (size_t b = 0; b < count; b++)
+		{
+			const Matrix4* world = &CommandBuffer::Identity();
+			for (const Command& command : buffers[b].Commands())
+			{
+				if (command.Type == CommandType::SetTransform)
+				{
+					world = &buffers[b].Transform(command.Index);
+				}
+				else if (command.Type == CommandType::DrawMesh)
+				{
+					addDraw(buffers[b].MeshAt(command.Index), *world, nullptr);
+				}
+				else if (command.Type == CommandType::DrawInstanced)
+				{
+					// the cull above went through the commands in this same order
+					const Mesh& mesh = buffers[b].MeshAt(command.Index);
+					const Vector3* normals = SharedMeshData(mesh).FaceNormals.data();
+					const Matrix4* transforms = &buffers[b].Transform(command.First);
+					const size_t end = visible + m_VisibleRuns[run++];
+					for (; visible < end; visible++)
+					{
+						addDraw(mesh, transforms[m_VisibleInstances[visible]], normals);
+					}
+				}
+			}
+		}
+
+		if (edges)
+		{
+			TransformPoints(slot);
+		}
+		else
+		{
+			if (smooth)
+				ShadeVertices(slot);
+			m_Jobs.ParallelFor(slot.ChunkCount, [this, &slot](size_t i) { TransformChunk(slot, i); });
+			FinishGeometry(slot, camera); // pieces are in view space already, every draw's camera is the same
+
+			// all meshes in one painter's order. Ids change with every submit, so there's no order to carry over
+			RadixSort(slot.Keys, slot.Scratch, slot.TriCount + slot.QuadCount, &m_Jobs);
+			SetupSlot(slot);
+			BinFaces(slot);
+		}
+		RasterSlot(slot);
+
+		for (size_t b = 0; b < count; b++)
+		{
+			const Matrix4* world = &CommandBuffer::Identity();
+			for (const Command& command : buffers[b].Commands())
+			{
+				if (command.Type == CommandType::SetTransform)
+				{
+					world = &buffers[b].Transform(command.Index);
+				}
+				else if (command.Type == CommandType::DrawLines && command.Filler != NoGlyph) // NoGlyph is never drawn
+				{
+					VertexStageSetup setup = camera;
+					setup.RotZ = *world;
+					const Vector3* points = buffers[b].Points(command.Index);
+					for (uint32_t i = 0; i + 1 < command.Count; i += 2)
+					{
+						Vector3 start = ViewPoint(setup, points[i]);
+						Vector3 end = ViewPoint(setup, points[i + 1]);
+						if (!ClipSegment(setup.ZNear, start, end))
+							continue;
+						start = ProjectView(setup, start);
+						end = ProjectView(setup, end);
+						DrawLine(COORD{ ToCell(start.x), ToCell(start.y) }, COORD{ ToCell(end.x), ToCell(end.y) }, command.Filler);
+					}
+				}
+			}
+		}
+
+		m_SceneValid = false; // the framebuffer doesn't hold Draw()'s scene anymore
+		PresentFrame(m_LastTiming);
+		m_PresentLatency = std::chrono::duration<float>(std::chrono::steady_clock::now() - slot.Submitted).count();
+	}
+
+	void Graphics::RecordScene(CommandBuffer& commands) const
+	{
+		const SceneState scene{ m_RotAngle, View, SceneLights(), Model.Version, m_ScreenWidth, m_ScreenHeight };
+		const VertexStageSetup setup = MakeVertexSetup(scene);
+		commands.SetTransform(setup.RotZ * setup.RotX);
+		commands.DrawMesh(Model);
+	}
+
+	// the cross product of a triangle's or a planar quad's diagonals, which for a triangle (fourth corner = first)
+	// is that of its edges. Twice the face's area long
+	template <size_t Corners>
+	static inline Vector3 FaceCross(const Vector3 (&verts)[Corners])
+	{
+		const Vector3& last = verts[3 % Corners];
+		const Vector3 a{ verts[2].x - verts[0].x, verts[2].y - verts[0].y, verts[2].z - verts[0].z };
+		const Vector3 b{ last.x - verts[1].x, last.y - verts[1].y, last.z - verts[1].z };
+		return Vector3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	template <size_t Corners>
+	static inline Vector3 FaceNormal(const Vector3 (&verts)[Corners])
+	{
+		const Vector3 cp = FaceCross(verts);
+		const float length = cp.Length();
+		const float scale{ length > 0.0f ? 1.0f / length : 0.0f }; // no area, no direction: unlit
+		return Vector3{ cp.x * scale, cp.y * scale, cp.z * scale };
+	}
+
+	const MeshData& Graphics::SharedMeshData(const Mesh& mesh)
+	{
+		MeshData& data = m_MeshData[&mesh];
+		if (data.Version == mesh.Version && data.Version != 0)
+			return data;
+
+		data.Version = mesh.Version;
+		data.LocalBounds = BoundsOf(mesh);
+		data.FaceNormals.clear();
+		data.FaceNormals.reserve(mesh.Tris.size() + mesh.Quads.size());
+		auto addFace = [&data](const auto& face)
+		{
+			data.FaceNormals.push_back(FaceNormal(face.verts));
+		};
+		for (const Triangle& tri : mesh.Tris)
+			addFace(tri);
+		for (const Quad& quad : mesh.Quads)
+			addFace(quad);
+
+		// faces carry their own copies of the corners; welding equal positions gives them back their shared vertices,
+		// and the edges between those can be found once each by sorting
+		struct PositionHash
+		{
+			size_t operator()(const Vector3& v) const
+			{
+				uint32_t bits[3]{};
+				std::memcpy(bits, &v, sizeof(bits));
+				return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+			}
+		};
+		struct PositionEqual
+		{
+			bool operator()(const Vector3& a, const Vector3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+		};
+		std::unordered_map<Vector3, uint32_t, PositionHash, PositionEqual> welded{};
+		std::vector<uint64_t> edges{};
+		std::vector<Vector3> normals{};
+		data.Vertices.clear();
+		data.Corners.clear();
+		data.Corners.reserve(mesh.Tris.size() * 3 + mesh.Quads.size() * 4);
+		auto addEdges = [&](const auto& face)
+		{
+			constexpr size_t Corners{ std::extent_v<decltype(face.verts)> };
+			uint32_t ids[Corners]{};
+			for (size_t i = 0; i < Corners; i++)
+			{
+				const Vector3 position{ face.verts[i].x + 0.0f, face.verts[i].y + 0.0f, face.verts[i].z + 0.0f }; // -0 is 0
+				const auto [found, added] = welded.try_emplace(position, static_cast<uint32_t>(data.Vertices.size()));
+				if (added)
+				{
+					data.Vertices.push_back(position);
+					normals.push_back(Vector3{});
+				}
+				ids[i] = found->second;
+				data.Corners.push_back(ids[i]);
+			}
+			// the unnormalized cross product: bigger faces count for more
+			const Vector3 cp = FaceCross(face.verts);
+			for (size_t i = 0; i < Corners; i++)
+			{
+				if (std::find(ids, ids + i, ids[i]) != ids + i)
+					continue; // corners that collapsed into one vertex count once
+				Vector3& normal = normals[ids[i]];
+				normal = Vector3{ normal.x + cp.x, normal.y + cp.y, normal.z + cp.z };
+			}
+			for (size_t i = 0; i < Corners; i++)
+			{
+				const uint32_t a{ ids[i] };
+				const uint32_t b{ ids[(i + 1) % Corners] };
+				if (a != b)
+					edges.push_back(uint64_t{ std::min(a, b) } << 32 | std::max(a, b));
+			}
+		};
+		for (const Triangle& tri : mesh.Tris)
+			addEdges(tri);
+		for (const Quad& quad : mesh.Quads)
+			addEdges(quad);
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		data.Edges.resize(edges.size());
+		for (size_t i = 0; i < edges.size(); i++)
+			data.Edges[i] = MeshEdge{ static_cast<uint32_t>(edges[i] >> 32), static_cast<uint32_t>(edges[i]) };
+
+		data.NormalX.resize(normals.size());
+		data.NormalY.resize(normals.size());
+		data.NormalZ.resize(normals.size());
+		for (size_t i = 0; i < normals.size(); i++)
+		{
+			const float length = normals[i].Length();
+			const float scale{ length > 0.0f ? 1.0f / length : 0.0f }; // faces that cancel out leave it unlit
+			data.NormalX[i] = normals[i].x * scale;
+			data.NormalY[i] = normals[i].y * scale;
+			data.NormalZ[i] = normals[i].z * scale;
+		}
+		return data;
+	}
+
+	// direction through the rotating part of the vertex stage, no translation or projection
+	static Vector3 RotateNormal(const VertexStageSetup& setup, const Vector3& normal)
+	{
+		auto rotate = [](const Matrix4& mat, const Vector3& vec)
+		{
+			return Vector3{
+				vec.x * mat.m[0][0] + vec.y * mat.m[1][0] + vec.z * mat.m[2][0],
+				vec.x * mat.m[0][1] + vec.y * mat.m[1][1] + vec.z * mat.m[2][1],
+				vec.x * mat.m[0][2] + vec.y * mat.m[1][2] + vec.z * mat.m[2][2]
+			};
+		};
+		const Vector3 rotated = rotate(setup.RotX, rotate(setup.RotZ, normal));
+		const float length = rotated.Length(); // a uniform scale still changes it
+		return Vector3{ rotated.x / length, rotated.y / length, rotated.z / length };
+	}
+
+	template <typename Face>
+	size_t Graphics::TransformFaces(const VertexStageSetup& setup, const std::vector<Face>& faces, size_t begin, size_t end,
+	                                Face* out, uint32_t* outSource, uint32_t* outCell, uint32_t* outClip, size_t& clipped,
+	                                const Vector3* normals, const uint32_t* corners, const uint8_t* shades)
+	{
+		constexpr size_t Corners{ std::extent_v<decltype(Face::verts)> };
+		const int width{ static_cast<int>(setup.ScreenWidth) };
+		const int height{ static_cast<int>(setup.ScreenHeight) };
+		SplatBatch batch{};
+		size_t misses{ 0 };
+		size_t count{ 0 };
+		clipped = 0;
+		for (size_t src = begin; src < end; src++)
+		{
+			const Face& face = faces[src];
+			Vector3 rotatedXZ[Corners];
+			int behind{ 0 };
+			for (size_t i = 0; i < Corners; i++)
+			{
+				rotatedXZ[i] = face.verts[i] * setup.RotZ * setup.RotX;
+				rotatedXZ[i].z += setup.ZOffset;
+				behind += rotatedXZ[i].z < setup.ZNear;
+			}
+
+			// one normal and one cull test per face, a quad is flat
+			const Vector3 normCp = normals ? RotateNormal(setup, normals[src]) : FaceNormal(rotatedXZ);
+			if(DotProduct(normCp, rotatedXZ[0]) > 0.0f) // see if less than 90 degrees
+			{
+				continue;
+			}
+
+			if (behind == Corners)
+				continue;
+
+			Vector3 proj[Corners];
+			bool inside{ behind == 0 };
+			if (behind == 0)
+			{
+				for (size_t i = 0; i < Corners; i++)
+				{
+					proj[i] = ProjectView(setup, rotatedXZ[i]);
+					inside = inside && InsideGuardBand(setup, proj[i]);
+				}
+				if (OffScreen(setup, proj))
+					continue;
+			}
+
+			Face toRaster{};
+			uint32_t cell{ RasterFace };
+			if (inside)
+			{
+				std::copy(proj, proj + Corners, toRaster.verts);
+				cell = ClassifyFace(toRaster.verts, Corners, width, height, batch, static_cast<uint32_t>(count));
+				if (cell == NoCell)
+					continue;
+			}
+			else
+			{
+				// crosses the camera plane or reaches too far off screen: clipped once the whole stage is done
+				std::copy(rotatedXZ, rotatedXZ + Corners, toRaster.verts);
+				outClip[clipped++] = static_cast<uint32_t>(count);
+			}
+
+			if (shades)
+			{
+				unsigned sum{ 0 };
+				for (size_t i = 0; i < Corners; i++)
+				{
+					toRaster.shade[i] = shades[corners[src * Corners + i]];
+					sum += toRaster.shade[i];
+				}
+				toRaster.filler = ShadeGlyphs[sum / Corners]; // for a splat, which has no room for more than one
+			}
+			else
+			{
+				Vector3 center{};
+				for (const Vector3& vert : rotatedXZ)
+					center = Vector3{ center.x + vert.x, center.y + vert.y, center.z + vert.z };
+				const float light{ FaceLight(setup.Lights, normCp, center * (1.0f / Corners)) };
+				toRaster.filler = LightGlyph(light);
+				// one shade at every corner: the face's colors. Negative intensities can take the light below 0
+				const float shade{ light > 0.0f ? std::min(light, 1.0f) * 255.0f + 0.5f : 0.0f }; // NaN is unlit too
+				std::fill(toRaster.shade, toRaster.shade + Corners, static_cast<uint8_t>(shade));
+			}
+
+			outSource[count] = static_cast<uint32_t>(src);
+			outCell[count] = cell;
+			out[count++] = toRaster;
+			if (batch.Count == 4)
+				misses += TestSplats(batch, outCell);
+		}
+		misses += TestSplats(batch, outCell);
+
+		// splats whose cell center turned out to be outside go, like faces that were culled
+		if (misses > 0)
+		{
+			size_t kept{ 0 };
+			size_t clip{ 0 };
+			for (size_t i = 0; i < count; i++)
+			{
+				if (outCell[i] == NoCell)
+					continue;
+				if (clip < clipped && outClip[clip] == i)
+					outClip[clip++] = static_cast<uint32_t>(kept);
+				out[kept] = out[i];
+				outSource[kept] = outSource[i];
+				outCell[kept] = outCell[i];
+				kept++;
+			}
+			count = kept;
+		}
+		return count;
+	}
+
+	void Graphics::DrawLine(COORD startPoint, COORD endPoint, Glyph fillChar)
+	{
+		if (m_Covered.size() != m_Frame.Cells().size()) // not cleared since the last resize
+			m_Covered.assign(m_Frame.Cells().size(), 0);
+		DrawSegment(startPoint.X, startPoint.Y, endPoint.X, endPoint.Y, fillChar, 0, m_Frame.Height() - 1);
+	}
+
+	size_t Graphics::DrawTriangle(const Triangle& tri, int minY, int maxY)
+	{
+		return DrawFace(tri.verts, 3, tri.filler, minY, maxY);
+	}
+
+	size_t Graphics::DrawQuad(const Quad& quad, int minY, int maxY)
+	{
+		return DrawFace(quad.verts, 4, quad.filler, minY, maxY);
+	}
+
+	size_t Graphics::DrawFace(const Vector3* verts, int corners, Glyph filler, int minY, int maxY)
+	{
+		if (m_Covered.size() != m_Frame.Cells().size()) // not cleared since the last resize
+			m_Covered.assign(m_Frame.Cells().size(), 0);
+		FaceSetup setup;
+		SetupFaces(&verts, &corners, 1, setup);
+		return DrawPolygon<RasterMode::Flat, false>(setup, 0, filler, minY, maxY);
+	}
+
+	template <RasterMode Mode, bool FrontToBack>
+	size_t Graphics::WriteSpan(int row, int first, int last, Glyph glyph, const ShadePlane* shade, ColorPair colors)
+	{
+		if (first > last)
+			return 0;
+		uint8_t* covered = m_Covered.data() + static_cast<size_t>(row) * m_Frame.Width();
+
+		// Smooth: the span is cut into segments of PerspectiveStep cells, the last one shorter. The shade is divided
+		// out exactly at segment ends, in between it steps in 16.16 fixed point. Columns only ever go up
+		float rowShade{ 0.0f };
+		float rowPerW{ 0.0f };
+		int period{ 1 };
+		if constexpr (Mode == RasterMode::Smooth)
+		{
+			rowShade = shade->Origin[0] + static_cast<float>(row) * shade->Dy[0];
+			rowPerW = shade->Origin[1] + static_cast<float>(row) * shade->Dy[1];
+			const int step{ static_cast<int>(std::min<unsigned>(m_PerspectiveStep, INT_MAX)) };
+			period = std::max(step == 0 || step > last - first ? last - first : step, 1);
+		}
+		auto exact = [shade, rowShade, rowPerW](int column)
+		{
+			const float perW{ rowPerW + static_cast<float>(column) * shade->Dx[1] };
+			const float value{ perW > 0.0f ? (rowShade + static_cast<float>(column) * shade->Dx[0]) / perW : 0.0f };
+			return static_cast<int32_t>(std::clamp(value, 0.0f, 255.99f) * 65536.0f);
+		};
+		int segment{ first };
+		int segmentEnd{ first - 1 }; // none yet
+		int32_t level{ 0 };
+		int32_t endLevel{ 0 };
+		int32_t delta{ 0 };
+		auto write = [&](int column)
+		{
+			if constexpr (Mode == RasterMode::Smooth)
+			{
+				if (column > segmentEnd)
+				{
+					const int start{ first + (column - first) / period * period };
+					const int end{ std::min(start + period, last) };
+					level = start == segmentEnd ? endLevel : exact(start);
+					endLevel = end > start ? exact(end) : level;
+					delta = end > start ? (endLevel - level) / (end - start) : 0;
+					segment = start;
+					segmentEnd = end;
+				}
+				const int32_t at{ level + delta * (column - segment) };
+				const size_t cellShade{ static_cast<size_t>(at >> 16) };
+				m_Frame.Set(column, row, ShadeGlyphs[cellShade], m_ShadeColors[cellShade]);
+			}
+			else if constexpr (Mode != RasterMode::DepthOnly)
+			{
+				m_Frame.Set(column, row, glyph, colors);
+			}
+			covered[column] = 1;
+		};
+		if constexpr (FrontToBack)
+		{
+			// nearer faces went first, only the cells none of them covered are still open
+			return m_Coverage.Fill(row, first, last, write);
+		}
+		else
+		{
+			for (int column = first; column <= last; column++)
+				write(column);
+			return static_cast<size_t>(last - first + 1);
+		}
+	}
+
+	// Cells whose centers are inside the convex polygon, in fixed point so neighbours agree exactly on their shared
+	// edges. A center exactly on an edge belongs to the polygon only if that's a top or left edge, which a shared
+	// edge is for exactly one of its two polygons: every cell of a surface is written once
+	template <RasterMode Mode, bool FrontToBack>
+	size_t Graphics::DrawPolygon(const FaceSetup& setup, size_t lane, Glyph filler, int minY, int maxY,
+	                             const ShadePlane* shade, ColorPair colors)
+	{
+		constexpr int64_t One{ SubCellOne };
+		constexpr int64_t Half{ One / 2 };
+
+		// rows whose centers are within the face's y range, and on screen. Faces with no area or no cell center
+		// have none at all
+		const int64_t topRow{ setup.Top[lane] };
+		const int64_t bottomRow{ setup.Bottom[lane] };
+		const int firstRow = std::max({ setup.Top[lane], minY, 0 });
+		const int lastRow = std::min({ setup.Bottom[lane], maxY, m_Frame.Height() - 1 });
+		if (firstRow > lastRow)
+			return 0;
+
+		struct Edge
+		{
+			int64_t Dx, Dy;
+			int64_t C; // E(px, py) = Dx * py - Dy * px + C
+		};
+		struct Span
+		{
+			int64_t First, Last; // columns, not clamped to the screen; empty if First > Last
+		};
+		const int64_t lastColumn = m_Frame.Width() - 1;
+		auto fill = [&](const Edge* edges, int edgeCount)
+		{
+			// E(px) >= 0 bounds px from one side, solved per edge
+			auto spanOf = [edges, edgeCount, topRow, bottomRow](int64_t row)
+			{
+				Span span{ INT64_MIN, INT64_MAX };
+				if (row < topRow || row > bottomRow)
+					return Span{ 1, 0 };
+				const int64_t py = row * One + Half;
+				for (int i = 0; i < edgeCount; i++)
+				{
+					const Edge& edge = edges[i];
+					const int64_t c = edge.Dx * py + edge.C;
+					if (edge.Dy == 0)
+					{
+						if (c < 0)
+							return Span{ 1, 0 };
+					}
+					else if (edge.Dy > 0) // px <= c / dy
+					{
+						span.Last = std::min(span.Last, FloorDiv(FloorDiv(c, edge.Dy) - Half, One));
+					}
+					else // px >= c / dy
+					{
+						span.First = std::max(span.First, CeilDiv(CeilDiv(-c, -edge.Dy) - Half, One));
+					}
+				}
+				return span;
+			};
+			auto write = [this, lastColumn, shade](int row, int64_t first, int64_t last, Glyph glyph, ColorPair cellColors)
+			{
+				return WriteSpan<Mode, FrontToBack>(row, static_cast<int>(std::max<int64_t>(first, 0)),
+				                                    static_cast<int>(std::min(last, lastColumn)), glyph, shade, cellColors);
+			};
+
+			size_t written{ 0 };
+			if constexpr (Mode == RasterMode::Wireframe)
+			{
+				// the outline is what the rows above and below don't reach past, plus the span's ends.
+				// The inside is blanked, so lines behind the face stay hidden
+				Span above{ spanOf(firstRow - 1) };
+				Span current{ spanOf(firstRow) };
+				for (int row = firstRow; row <= lastRow; row++)
+				{
+					const Span below{ spanOf(row + 1) };
+					const int64_t innerFirst = std::max({ current.First + 1, above.First, below.First });
+					const int64_t innerLast = std::min({ current.Last - 1, above.Last, below.Last });
+					const bool full = FrontToBack && m_Coverage.RowFull(row);
+					if (!full && innerFirst > innerLast)
+					{
+						written += write(row, current.First, current.Last, filler, colors);
+					}
+					else if (!full)
+					{
+						written += write(row, current.First, innerFirst - 1, filler, colors);
+						written += write(row, innerFirst, innerLast, ' ', DefaultColors);
+						written += write(row, innerLast + 1, current.Last, filler, colors);
+					}
+					above = current;
+					current = below;
+				}
+			}
+			else
+			{
+				for (int row = firstRow; row <= lastRow; row++)
+				{
+					if (FrontToBack && m_Coverage.RowFull(row))
+						continue;
+					const Span span{ spanOf(row) };
+					written += write(row, span.First, span.Last, filler, colors);
+				}
+			}
+			return written;
+		};
+
+		// corners snapped together leave zero length edges, they bound nothing
+		Edge edges[4];
+		int edgeCount{ 0 };
+		const int split{ setup.Split[lane] };
+		if (split < 0)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				if (setup.Dx[i][lane] != 0 || setup.Dy[i][lane] != 0)
+					edges[edgeCount++] = Edge{ setup.Dx[i][lane], setup.Dy[i][lane], setup.C[i][lane] };
+			}
+			return fill(edges, edgeCount);
+		}
+
+		// snapping bent this corner of a quad inwards, the edges' half planes would cut it off. Split the quad into
+		// two triangles across the corner instead, their shared edge keeps them watertight
+		auto edge = [&setup, lane](int from, int to)
+		{
+			const int64_t x{ setup.X[from][lane] };
+			const int64_t y{ setup.Y[from][lane] };
+			const int64_t dx = setup.X[to][lane] - x;
+			const int64_t dy = setup.Y[to][lane] - y;
+			const bool topLeft = dy < 0 || (dy == 0 && dx > 0); // left edges go up, top edges go right
+			return Edge{ dx, dy, dy * x - dx * y + (topLeft ? 0 : -1) };
+		};
+		const int next{ (split + 1) % 4 };
+		const int opposite{ (split + 2) % 4 };
+		const int prev{ (split + 3) % 4 };
+		const Edge a[3]{ edge(split, next), edge(next, opposite), edge(opposite, split) };
+		const Edge b[3]{ edge(opposite, prev), edge(prev, split), edge(split, opposite) };
+		size_t written{ 0 };
+		for (const Edge* triangle : { a, b })
+		{
+			edgeCount = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				if (triangle[i].Dx != 0 || triangle[i].Dy != 0)
+					edges[edgeCount++] = triangle[i];
+			}
+			written += fill(edges, edgeCount);
+		}
+		return written;
+	}
+
+	Glyph Graphics::PixelIllumination(const LightSet& lights, const Vector3& normal, const Vector3& center)
+	{
+		return LightGlyph(FaceLight(lights, normal, center));
+	}
+
+	void Graphics::SetColorMode(ColorMode mode, Rgb color, unsigned levels)
+	{
+		levels = std::clamp(levels, 1u, 255u);
+		auto scaled = [color](float scale)
+		{
+			return Rgb{ static_cast<uint8_t>(color.R * scale + 0.5f), static_cast<uint8_t>(color.G * scale + 0.5f),
+			            static_cast<uint8_t>(color.B * scale + 0.5f) };
+		};
+		std::vector<ColorPairRgb> pairs(mode == ColorMode::Mono ? 0 : levels);
+		for (size_t level = 0; level < pairs.size(); level++)
+		{
+			// the top of each step's range, so a fully lit face is the color itself
+			const float scale{ static_cast<float>(level + 1) / static_cast<float>(levels) };
+			pairs[level] = ColorPairRgb{ scaled(scale), scaled(scale * 0.35f) };
+		}
+		for (size_t shade = 0; shade < m_ShadeColors.size(); shade++)
+			m_ShadeColors[shade] = pairs.empty() ? DefaultColors : static_cast<ColorPair>(1 + shade * levels / 256);
+		m_Colored = !pairs.empty();
+		m_Presenter.SetColors(mode, pairs.data(), pairs.size());
+		m_SceneValid = false; // the framebuffer's colors are the old ones
+	}
+
+	void Graphics::SetGlyphEncoding(GlyphEncoding encoding)
+	{
+		SetConsoleOutputCP(encoding == GlyphEncoding::Cp437 ? 437 : CP_UTF8);
+		m_Presenter.SetEncoding(encoding);
+	}
+
+	HANDLE Graphics::OpenPresentOutput()
+	{
+		if (GetFileType(m_ConsoleOutHandle) == FILE_TYPE_PIPE) // remote/redirected: write straight to the pipe
+			return m_ConsoleOutHandle;
+
+		// curses switched to its own screen buffer, CONOUT$ resolves to whichever buffer is active now
+		m_ConsoleBufferHandle = CreateFileW(L"CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		                                    nullptr, OPEN_EXISTING, 0, nullptr);
+		if (m_ConsoleBufferHandle == INVALID_HANDLE_VALUE)
+			return m_ConsoleOutHandle;
 
-		return " ";
+		DWORD mode{};
+		GetConsoleMode(m_ConsoleBufferHandle, &mode);
+		SetConsoleMode(m_ConsoleBufferHandle,
+		               mode | ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING | DISABLE_NEWLINE_AUTO_RETURN);
+		return m_ConsoleBufferHandle;
 	}
 
 	std::pair<unsigned, unsigned> Graphics::GetWindowBoundsSize() const
@@ -7,9 +7,20 @@
 #include <io.h> // for _setmode()
 #include <fcntl.h>
 #include <vector>
+#include <array>
+#include <unordered_map>
 #include <utility> // for std::pair
+#include <chrono>
+#include <climits>
+#include <cstdint>
 
 #include "curses.h"
+#include "arena.h"
+#include "coverage.h"
+#include "depthsort.h"
+#include "frameclock.h"
+#include "presenter.h"
+#include "jobsystem.h"
 
 //#define NEW_OBJ // Load new quad model or old poly
 #undef  NEW_OBJ
@@ -91,15 +102,29 @@ namespace TG
 
 		friend Vector3 operator*(const Matrix4& mat, const Vector3& vec);
 		friend Vector3 operator*(const Vector3& vec, const Matrix4& mat);
+		friend Matrix4 operator*(const Matrix4& a, const Matrix4& b); // a then b, like vec * a * b
 	};
 
 	struct Triangle
 	{
 		Vector3 verts[3]{};
 
-		const char* filler{ "?" };
+		Glyph filler{ '?' };
+		uint8_t shade[3]{}; // RasterMode::Smooth: the light at each corner, 0-255
 	};
 
+	// a face of four corners in one plane, drawn as a single convex polygon
+	struct Quad
+	{
+		Vector3 verts[4]{};
+
+		Glyph filler{ '?' };
+		uint8_t shade[4]{};
+	};
+
+	// corners in one plane, every turn going the same way: the quad can stay a Quad instead of two triangles
+	bool IsFlatConvex(const Quad& quad);
+
 	class Mesh
 	{
 	public:
@@ -111,9 +136,14 @@ namespace TG
 		} ModelReadMode;
 
 		std::vector<Triangle> Tris{};
+		std::vector<Quad> Quads{}; // planar quads of RM_NEW files, the others are split into Tris
+		unsigned Version{}; // changes whenever Tris or Quads do, see Touch()
 
 		constexpr Mesh() = default;
 
+		// call after editing Tris or Quads so cached renders of the mesh get invalidated
+		void Touch() { Version = NextVersion(); }
+
 		explicit Mesh(const char* fileName, const char* mode = "old")
 		{
 			if(strcmp(mode, "old") == 0)
@@ -127,6 +157,8 @@ namespace TG
 				ModelReadMode = RM_ERROR;
 			}
 
+			Touch();
+
 			std::vector<Vector3> verts{};
 
 			std::ifstream file(fileName);
@@ -157,7 +189,7 @@ namespace TG
 						int index{ 0 };
 						std::string token{};
 						s >> token; // skip 'f'
-						while (s >> token)
+						while (s >> token && index < 4)
 						{
 							size_t slashPos = token.find('/');
 							if (slashPos != std::string::npos) {
@@ -166,6 +198,17 @@ namespace TG
 								index++;
 							}
 						}
+						if (index == 3)
+						{
+							Tris.emplace_back(Triangle{ verts[ti[0] - 1], verts[ti[1] - 1], verts[ti[2] - 1] });
+							continue;
+						}
+						const Quad quad{ verts[ti[0] - 1], verts[ti[1] - 1], verts[ti[2] - 1], verts[ti[3] - 1] };
+						if (IsFlatConvex(quad))
+						{
+							Quads.push_back(quad);
+							continue;
+						}
 						Tris.emplace_back(Triangle{ verts[ti[0] - 1], verts[ti[2] - 1], verts[ti[3] - 1] }); // first triangle
 						Tris.emplace_back(Triangle{ verts[ti[0] - 1], verts[ti[1] - 1], verts[ti[2] - 1] }); // second triangle
 					}
@@ -180,8 +223,260 @@ namespace TG
 				}
 			}
 		}
+
+	private:
+		static unsigned NextVersion()
+		{
+			static unsigned counter{ 0 };
+			return ++counter;
+		}
+	};
+
+	struct Camera
+	{
+		float ZOffset{ 20.0f }; // how far in front of the camera the model sits
+		float Fov{ 80.0f }; // degrees
+		float ZNear{ 0.1f };
+		float ZFar{ 1000.0f };
+	};
+
+	enum class LightType : uint8_t
+	{
+		Directional, // same direction everywhere, like the sun
+		Point // shines out from Position in every direction, no falloff
+	};
+
+	// in view space: the camera is at the origin looking down +z. A face is lit by how squarely it faces the light
+	struct Light
+	{
+		LightType Type{ LightType::Directional };
+		Vector3 Direction{ 0, 0, -1 }; // Directional: unit, from the faces towards the light
+		Vector3 Position{}; // Point
+		float Intensity{ 1.0f }; // the lights add up, anything past 1 is fully lit
+	};
+
+	constexpr size_t MaxLights{ 8 };
+
+	// a frame's lights, a fixed array so scenes stay cheap to copy and compare
+	struct LightSet
+	{
+		Light Items[MaxLights]{};
+		size_t Count{};
+	};
+
+	// axis aligned box
+	struct Bounds
+	{
+		Vector3 Min{};
+		Vector3 Max{};
+
+		void Expand(const Bounds& other);
+		float SurfaceArea() const;
+		bool operator==(const Bounds& other) const;
+	};
+
+	// inside is n.p + d >= 0
+	struct Plane
+	{
+		Vector3 Normal{};
+		float D{};
+	};
+
+	struct Frustum
+	{
+		Plane Planes[6]{};
+
+		// the volume Graphics::Submit() draws into, in the world space of SetTransform/DrawMesh
+		static Frustum FromCamera(const Camera& camera, short screenWidth, short screenHeight);
 	};
 
+	// local box through an affine transform: the center moves, the extents spread over every axis they rotate into
+	Bounds TransformBounds(const Bounds& local, const Matrix4& transform);
+	// the box around every face corner of the mesh, in its own space. An empty mesh has an empty box at the origin
+	Bounds BoundsOf(const Mesh& mesh);
+
+	// two corners of a face, indices into MeshData::Vertices, A < B
+	struct MeshEdge
+	{
+		uint32_t A{};
+		uint32_t B{};
+	};
+
+	// what every instance of a mesh shares, computed once per mesh version
+	struct MeshData
+	{
+		unsigned Version{};
+		Bounds LocalBounds{};
+		std::vector<Vector3> FaceNormals{}; // unit, in object space, one per triangle, then one per quad
+		// the faces' corners as an index buffer: equal positions are one vertex, and an edge shared by several
+		// faces is in Edges once
+		std::vector<Vector3> Vertices{};
+		std::vector<MeshEdge> Edges{};
+		std::vector<uint32_t> Corners{}; // each face's vertices: three per triangle, then four per quad
+		// unit vertex normals, the normals of the faces around each vertex weighted by their area. One array per
+		// axis, the shading pass goes through them a batch of vertices at a time
+		std::vector<float> NormalX{};
+		std::vector<float> NormalY{};
+		std::vector<float> NormalZ{};
+	};
+
+	// what the rasterizer writes for the cells a face covers
+	enum class RasterMode
+	{
+		Flat, // the face's glyph
+		Smooth, // the shade of each cell, interpolated from the light at the face's vertices (Gouraud)
+		Wireframe, // its glyph on the outline, blank inside: hidden lines stay hidden
+		DepthOnly, // nothing, only coverage and the overdraw stats
+		Edges // no faces: every edge of the mesh once as a line, hidden ones too. No depth sort, a preview for dense meshes
+	};
+
+	// everything a frame's image depends on. Same state as last frame -> same image, nothing to render
+	struct SceneState
+	{
+		float RotAngle{};
+		Camera View{};
+		LightSet Lights{};
+		unsigned MeshVersion{};
+		short ScreenWidth{};
+		short ScreenHeight{};
+		bool FrontToBack{}; // how it's rasterized, not what it looks like
+		RasterMode Raster{};
+		unsigned PerspectiveStep{};
+	};
+
+	// per-frame constants of the vertex stage, read by all workers
+	struct VertexStageSetup
+	{
+		Matrix4 RotX{};
+		Matrix4 RotZ{};
+		Matrix4 Proj{};
+		float ZOffset{};
+		float ZNear{};
+		LightSet Lights{};
+		float ScreenWidth{};
+		float ScreenHeight{};
+	};
+
+	// the rasterizer snaps vertices to fixed point, with this many bits below a cell
+	constexpr int SubCellBits{ 8 };
+	constexpr int64_t SubCellOne{ 1 << SubCellBits };
+
+	inline int64_t ToSubCell(float v) { return static_cast<int64_t>(v * SubCellOne + (v >= 0.0f ? 0.5f : -0.5f)); } // rounded
+
+	// floor/ceil of a / b for b > 0, also for negative a
+	inline int64_t FloorDiv(int64_t a, int64_t b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+	inline int64_t CeilDiv(int64_t a, int64_t b) { return -FloorDiv(-a, b); }
+
+	struct RasterStats
+	{
+		size_t Fragments{}; // cell writes
+		size_t Covered{}; // cells written at least once
+		float Time{}; // seconds
+
+		float Overdraw() const { return Covered ? static_cast<float>(Fragments) / static_cast<float>(Covered) : 0.0f; }
+	};
+
+	// a slice of a mesh's triangles or quads for one vertex stage job, written to the frame's Tris or Quads at Out
+	struct VertexChunk
+	{
+		const VertexStageSetup* Setup{};
+		const Mesh* Source{};
+		const Vector3* Normals{}; // instances only
+		const uint32_t* Corners{}; // RasterMode::Smooth: the mesh's MeshData::Corners, and its draw's vertex shades
+		const uint8_t* Shades{};
+		bool Quads{};
+		size_t Begin{};
+		size_t End{};
+		size_t Out{};
+	};
+
+	struct FaceSetup; // setup.h
+
+	// RasterMode::Smooth: a face's shade. Shade / w and 1 / w are both linear on screen, at cell (column, row)'s
+	// center each is Origin + column * Dx + row * Dy; the shade is their ratio. Without perspective 1 / w is 1
+	struct ShadePlane
+	{
+		float Origin[2]; // [0] shade / w, [1] 1 / w
+		float Dx[2];
+		float Dy[2];
+	};
+
+	// a draw whose welded vertices go through a per vertex pass (RasterMode::Edges and Smooth), at Out in the
+	// frame's vertex arrays
+	struct VertexDraw
+	{
+		const VertexStageSetup* Setup{};
+		const MeshData* Data{};
+		size_t Out{};
+	};
+
+	// the vertex shades of the last frame that shaded any, by draw. A draw with the same mesh data, transform and
+	// lights as the one at its index there gets the same shades
+	struct VertexLightCache
+	{
+		struct Draw
+		{
+			const MeshData* Data{};
+			unsigned Version{};
+			Matrix4 RotX{};
+			Matrix4 RotZ{};
+			float ZOffset{};
+			size_t Out{}; // into Shades
+		};
+
+		LightSet Lights{};
+		std::vector<Draw> Draws{};
+		std::vector<uint8_t> Shades{};
+	};
+
+	// one frame on its way through the pipeline: its scene, its geometry and the buffers they live in.
+	// Frames in flight each have their own, so the geometry of the next frame never touches this one's
+	struct FrameSlot
+	{
+		SceneState Scene{};
+		VertexStageSetup Setup{};
+		FrameArena Arena{};
+		size_t MeshSize{}; // triangles + quads
+		size_t ChunkCount{};
+		VertexChunk* Chunks{};
+		Triangle* Tris{}; // transformed triangles
+		Quad* Quads{}; // transformed quads, primitive TriCount + i
+		// id of each primitive: Tris then Quads. Mesh triangles are their index, quads count on from the mesh's
+		// triangles, pieces of clipped faces count on from MeshSize
+		uint32_t* Source{};
+		uint32_t* QuadSource{}; // until packed after the triangles' in Source
+		uint32_t* Cells{}; // of each primitive, like Source: the one cell of a splat, or RasterFace, see splat.h
+		uint32_t* QuadCells{}; // until packed
+		FaceSetup* Setups{}; // of every primitive, SetupLanes to a record; splats' lanes are left empty
+		ShadePlane* ShadePlanes{}; // of every primitive, RasterMode::Smooth only
+		size_t* ChunkOutput{};
+		uint32_t* Clip{}; // Tris entries left in view space because they need clipping, per chunk until packed
+		uint32_t* QuadClip{}; // same for Quads
+		size_t* ChunkClipped{};
+		size_t TriCount{};
+		size_t QuadCount{};
+		size_t Capacity{}; // of Tris; Source, Cells, Keys and Scratch have room for QuadCapacity more. Clipping may grow them
+		size_t QuadCapacity{};
+		size_t IdCount{}; // Source ids in use
+		DepthKey* Keys{};
+		DepthKey* Scratch{};
+		unsigned BandCount{};
+		int BandHeight{};
+		uint32_t* BandStart{}; // BandCount + 1 offsets into BandTris
+		uint32_t* BandTris{}; // primitive indices per band of rows, in painter's order
+		VertexDraw* VertexDraws{}; // RasterMode::Edges and Smooth only
+		size_t VertexDrawCount{};
+		size_t VertexCount{};
+		Vector3* ViewPoints{}; // Edges: every draw's vertices in view space, the edges are drawn instead of the primitives
+		Vector3* ScreenPoints{}; // projected, if in front of the near plane
+		uint8_t* Shades{}; // Smooth: the light at every draw's vertices
+		SortStats Sort{}; // the next frame may be sorting already, keep this one's numbers here
+		Job* Geometry{}; // done once the slot is ready to rasterize
+		std::chrono::steady_clock::time_point Submitted{};
+	};
+
+	class CommandBuffer;
+
 	const Vector3& CrossProduct(const Vector3& a, const Vector3& b);
 	float DotProduct(const Vector3& a, const Vector3& b);
 
@@ -190,12 +485,56 @@ namespace TG
 	public:
 		void SetCursorPosition(COORD pos);
 		void Clear();
-		void Draw(float elapsedTime);
-		void DrawLine(COORD startPoint, COORD endPoint, const char fillChar[]);
-		void DrawTriangle(Triangle tri);
-		const char* PixelIllumination(const Vector3& lightDir, const Vector3& normal);
+		void Update(float step); // fixed-step simulation, independent of the render rate
+		void Draw(const FrameTiming& timing);
+		void DrawLine(COORD startPoint, COORD endPoint, Glyph fillChar);
+		// only rows [minY, maxY] are written, so bands of the screen can be filled in parallel. Returns cells written
+		size_t DrawTriangle(const Triangle& tri, int minY = 0, int maxY = INT_MAX);
+		size_t DrawQuad(const Quad& quad, int minY = 0, int maxY = INT_MAX); // the quad must be convex
+		// glyph of a face with this view space normal and center
+		Glyph PixelIllumination(const LightSet& lights, const Vector3& normal, const Vector3& center);
+
+		COORD GetScreenSize() const { return COORD{ m_ScreenWidth, m_ScreenHeight }; }
+		const PresentStats& GetPresentStats() const { return m_Presenter.Stats(); }
+		const SortStats& GetSortStats() const { return m_SortStats; } // of the last presented frame
+		const RasterStats& GetRasterStats() const { return m_RasterStats; } // of the last rasterized frame
+		// threads running the frame's jobs, 0 = one per hardware thread
+		void SetThreadCount(unsigned threads) { m_Jobs.SetThreadCount(threads); }
+		// records every job's start/end, WriteJobTrace saves them for chrome://tracing
+		void EnableJobTrace(bool enable) { m_Jobs.EnableTrace(enable); }
+		bool WriteJobTrace(const char* fileName) const { return m_Jobs.WriteTrace(fileName); }
+		// what glyphs go to the terminal as; CP437 switches the console to that code page, so blocks stay one byte
+		void SetGlyphEncoding(GlyphEncoding encoding);
+		// cells in color: a face's light picks a pair from dark to full color, foreground and a darker background.
+		// Quantized to levels steps (at most 255), so neighbouring cells mostly share a pair and the presenter sends
+		// one SGR sequence per run of them instead of one per cell. Mono is glyphs only
+		void SetColorMode(ColorMode mode, Rgb color = Rgb{ 255, 255, 255 }, unsigned levels = 16);
+
+		// frames in flight. 1 renders every frame before presenting it; 2-3 transform and sort the next frames
+		// while the current one is rasterized and encoded, more throughput for depth - 1 frames of latency
+		void SetPipelineDepth(unsigned depth);
+		unsigned GetPipelineDepth() const { return m_PipelineDepth; }
+		float GetPresentLatency() const { return m_PresentLatency; } // seconds from a frame's Draw to its Present
+		// presents every frame still in the pipeline. Call it before editing Model while pipelining
+		void Flush();
+
+		// renders the commands of all buffers as one frame and presents it, see CommandBuffer
+		void Submit(const CommandBuffer* buffers, size_t count = 1, const FrameTiming& timing = FrameTiming{});
+		// the current model and rotation as commands, e.g. to save a frame for replaying
+		void RecordScene(CommandBuffer& commands) const;
 
 		Mesh Model;
+		Camera View{};
+		std::vector<Light> Lights{ Light{} }; // at most MaxLights, Draw throws on more
+		bool Paused{ false }; // stops the model rotation
+		// rasterize nearest faces first and never write a cell twice; stops once the screen is covered.
+		// Same image as painter's order, less work when faces hide each other
+		bool FrontToBack{ false };
+		RasterMode Raster{ RasterMode::Flat };
+		// RasterMode::Smooth under perspective: the exact shade, one division, at both ends of a span and every
+		// PerspectiveStep cells in between, linear steps from one to the next. 1 is exact everywhere, more is less
+		// work per cell and less exact, wider than the screen divides at span ends only. 0 is linear on screen
+		unsigned PerspectiveStep{ 8 };
 
 		explicit Graphics(COORD screenSize, int argc, char* argv[])
 		{
@@ -235,9 +574,17 @@ namespace TG
 			int row, col;
 			getmaxyx(stdscr, row, col);
 
+			m_Frame.Resize(screenSize.X, screenSize.Y);
+			m_Presenter.SetOutput(OpenPresentOutput());
+			m_Presenter.SetJobSystem(&m_Jobs);
+
 			if(argc > 1)
 			{
-				if(argc > 2) // with user's read mode
+				if (strncmp(argv[1], "--", 2) == 0)
+				{
+					// options only, e.g. replaying a recording: no model to load
+				}
+				else if(argc > 2 && strncmp(argv[2], "--", 2) != 0) // with user's read mode
 				{
 					Model = Mesh{ argv[1], argv[2]};
 				}else // default read mode (old)
@@ -257,6 +604,7 @@ namespace TG
 
 		~Graphics()
 		{
+			DiscardPending();
 			Shutdown();
 		}
 
@@ -277,9 +625,96 @@ namespace TG
 		std::pair<unsigned, unsigned> m_NewConsoleScreenSize{};
 		// TODO: make this field a std::optional type of (because SetConsoleScreenSize function may be failed)
 		std::pair<unsigned, unsigned> m_WindowBoundsSize{};
+		HANDLE m_ConsoleBufferHandle{INVALID_HANDLE_VALUE}; // CONOUT$, opened after curses took over the screen
+		FrameBuffer m_Frame{};
+		Presenter m_Presenter{};
+		float m_RotAngle{ 0.0f };
+		float m_PrevRotAngle{ 0.0f };
+		SceneState m_LastScene{};
+		bool m_SceneValid{ false };
+		unsigned long long m_SkippedFrames{};
+		std::vector<Glyph> m_OverlayBackup{};
+		std::vector<ColorPair> m_OverlayColorsBackup{};
+		std::array<ColorPair, 256> m_ShadeColors{}; // a shade's color pair, all DefaultColors in mono
+		bool m_Colored{ false };
+		unsigned long long m_LastAllocationCount{};
+		unsigned long long m_FrameAllocations{};
+		CoherentDepthSort m_DepthSort{};
+		SortStats m_SortStats{};
+		RasterStats m_RasterStats{};
+		std::vector<uint8_t> m_Covered{}; // cells written since Clear(), for the overdraw ratio
+		CoverageBuffer m_Coverage{}; // of the frame being rasterized front to back
+		unsigned m_PerspectiveStep{}; // of the frame being rasterized
+		constexpr static unsigned MaxPipelineDepth{ 3 };
+		FrameSlot m_Slots[MaxPipelineDepth]{};
+		unsigned m_PipelineDepth{ 1 };
+		unsigned m_PendingFirst{}; // oldest frame in flight, frames are submitted into the following slots
+		unsigned m_PendingCount{};
+		float m_PresentLatency{};
+		FrameTiming m_LastTiming{};
+		JobSystem m_Jobs{};
+		unsigned m_SortedMeshVersion{};
+		std::unordered_map<const Mesh*, MeshData> m_MeshData{}; // of instanced meshes and meshes drawn as edges
+		VertexLightCache m_VertexLight{};
+		std::vector<uint32_t> m_VisibleInstances{};
+		std::vector<size_t> m_VisibleRuns{}; // visible instances of each instanced draw, in m_VisibleInstances
 
 	private:
 
+		HANDLE OpenPresentOutput();
+		// arena buffers and raster bands for a frame of up to triangles triangles and quads quads
+		void PrepareSlot(FrameSlot& slot, const SceneState& scene, size_t triangles, size_t quads, size_t chunks);
+		// starts transform, sort and binning of scene in slot, returns right away
+		void SubmitGeometry(const SceneState& scene, FrameSlot& slot);
+		void RasterSlot(const FrameSlot& slot);
+		// waits for the oldest frame in flight, rasterizes and presents it
+		void RetireFrame();
+		void PresentFrame(const FrameTiming& timing);
+		void DiscardPending();
+		// vertex stage for faces[begin, end) (Triangle or Quad): transform, cull, project, shade, and sort out the
+		// ones smaller than a cell (outCell, see splat.h). Returns faces written. Faces crossing the near plane or
+		// the guard band are written unprojected and listed in outClip, see ClipFaces(). With normals (object
+		// space, per face) the faces aren't recomputed: only right for transforms without non-uniform scale,
+		// which instances are
+		template <typename Face>
+		size_t TransformFaces(const VertexStageSetup& setup, const std::vector<Face>& faces, size_t begin, size_t end,
+		                      Face* out, uint32_t* outSource, uint32_t* outCell, uint32_t* outClip, size_t& clipped,
+		                      const Vector3* normals = nullptr, const uint32_t* corners = nullptr,
+		                      const uint8_t* shades = nullptr);
+		static size_t ChunksOf(const Mesh& mesh);
+		// the mesh's vertex chunks for one draw, writing at triOut / quadOut in the slot, which they advance.
+		// Smooth shading reads the draw's vertex shades, the last vertex draw added
+		static void AddChunks(FrameSlot& slot, const VertexStageSetup& setup, const Mesh& mesh, const Vector3* normals,
+		                      size_t& triOut, size_t& quadOut);
+		void TransformChunk(FrameSlot& slot, size_t chunk);
+		void SetupSlot(FrameSlot& slot); // every face's FaceSetup lane, after FinishGeometry
+		// RasterMode::Edges and Smooth: room for the draws and their vertices, and a draw
+		static void PrepareVertices(FrameSlot& slot, size_t draws, size_t vertices);
+		static void AddVertexDraw(FrameSlot& slot, const VertexStageSetup& setup, const MeshData& data);
+		void TransformPoints(FrameSlot& slot); // Edges: the vertices through the vertex stage
+		// Smooth: the light at every vertex, before the faces' vertex stage. Draws lit the same way last frame are
+		// copied from m_VertexLight; frames in flight must shade one after another
+		void ShadeVertices(FrameSlot& slot);
+		size_t DrawEdges(const FrameSlot& slot, size_t band);
+		// both ends included, rows [minY, maxY] only. Returns cells written
+		size_t DrawSegment(int x0, int y0, int x1, int y1, Glyph glyph, int minY, int maxY);
+		// the kernels, one per mode and order. FrontToBack only writes cells no nearer face has written yet, closing them
+		template <RasterMode Mode, bool FrontToBack>
+		size_t RasterBand(const FrameSlot& slot, size_t band);
+		template <RasterMode Mode, bool FrontToBack>
+		size_t DrawPolygon(const FaceSetup& setup, size_t lane, Glyph filler, int minY, int maxY,
+		                   const ShadePlane* shade = nullptr, ColorPair colors = DefaultColors);
+		// Smooth takes each cell's glyph and colors from shade instead of glyph and colors
+		template <RasterMode Mode, bool FrontToBack>
+		size_t WriteSpan(int row, int first, int last, Glyph glyph, const ShadePlane* shade = nullptr,
+		                 ColorPair colors = DefaultColors);
+		size_t DrawFace(const Vector3* verts, int corners, Glyph filler, int minY, int maxY); // one face, set up on the spot
+		const MeshData& SharedMeshData(const Mesh& mesh);
+		LightSet SceneLights() const; // Lights as a scene's, throws if there are too many
+
+		constexpr static size_t VertexChunkSize{ 2048 };
+		constexpr static unsigned MaxRasterBands{ 16 };
+
 		std::pair<unsigned, unsigned> GetWindowBoundsSize() const;
 
 		void SetConsoleBuffSize(short cols, short rows) const;
@@ -291,6 +726,13 @@ namespace TG
 
 		void Shutdown()
 		{
+			if (m_ConsoleBufferHandle != INVALID_HANDLE_VALUE)
+			{
+				m_Presenter.SetOutput(INVALID_HANDLE_VALUE);
+				CloseHandle(m_ConsoleBufferHandle);
+				m_ConsoleBufferHandle = INVALID_HANDLE_VALUE;
+			}
+
 			endwin(); // curses
 
 			SetCurrentConsoleFontEx(GetStdHandle(STD_OUTPUT_HANDLE), FALSE, &m_DefaultCfi);